@@ -0,0 +1,120 @@
+#ifndef U7_ALGORITHM_BIT_MATRIX_H_
+#define U7_ALGORITHM_BIT_MATRIX_H_
+
+#include <cstdint>
+#include <memory>
+
+namespace u7::algorithm {
+
+// A bit-packed matrix of booleans.
+//
+// Every row occupies a whole number of 64-bit words, so the rows can be
+// processed word by word. The padding bits at the end of each row are always
+// zero.
+//
+// Like Matrix, the bit matrix can be surrounded by a border of the given
+// width, addressable with indices in [-border, 0) and [n, n + border).
+class BitMatrix {
+ public:
+  using Word = uint64_t;
+
+  static constexpr int kWordBits = 64;
+
+  BitMatrix() = default;
+
+  BitMatrix(int n, int m, int border = 0)
+      : n_(n),
+        m_(m),
+        border_(border),
+        wordsPerRow_((m + 2 * border + kWordBits - 1) / kWordBits),
+        a_(new Word[static_cast<size_t>(n + 2 * border) * wordsPerRow_]) {}
+
+  BitMatrix(BitMatrix&& rhs) noexcept = default;
+
+  BitMatrix& operator=(BitMatrix&& rhs) noexcept = default;
+
+  [[nodiscard]] int n() const { return n_; }
+
+  [[nodiscard]] int m() const { return m_; }
+
+  [[nodiscard]] int border() const { return border_; }
+
+  [[nodiscard]] int WordsPerRow() const { return wordsPerRow_; }
+
+  // Fills the matrix, including the border.
+  void Fill(bool x) {
+    const int width = m_ + 2 * border_;
+    for (int i = -border_; i < n_ + border_; ++i) {
+      Word* row = Row(i);
+      for (int k = 0; k < wordsPerRow_; ++k) {
+        row[k] = (x ? ~Word{0} : Word{0});
+      }
+      if (x && width % kWordBits != 0) {
+        row[wordsPerRow_ - 1] = (Word{1} << (width % kWordBits)) - 1;
+      }
+    }
+  }
+
+  // Fills the border only.
+  void FillBorder(bool x) {
+    for (int i = -border_; i < n_ + border_; ++i) {
+      if (i >= 0 && i < n_) {
+        for (int j = 1; j <= border_; ++j) {
+          UnsafeSet(i, -j, x);
+          UnsafeSet(i, m_ - 1 + j, x);
+        }
+      } else {
+        for (int j = -border_; j < m_ + border_; ++j) {
+          UnsafeSet(i, j, x);
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] bool UnsafeAt(int i, int j) const {
+    return (Row(i)[BitIndex(j) / kWordBits] >> (BitIndex(j) % kWordBits)) & 1;
+  }
+
+  void UnsafeSet(int i, int j, bool x) {
+    Word& word = Row(i)[BitIndex(j) / kWordBits];
+    const Word mask = Word{1} << (BitIndex(j) % kWordBits);
+    word = (x ? (word | mask) : (word & ~mask));
+  }
+
+  // Returns the position of the column j within the row words.
+  [[nodiscard]] int BitIndex(int j) const { return j + border_; }
+
+  // Returns the words of the i-th row; the bit BitIndex(j) % 64 of the word
+  // BitIndex(j) / 64 corresponds to the cell (i, j).
+  [[nodiscard]] const Word* Row(int i) const {
+    return a_.get() + static_cast<size_t>(i + border_) * wordsPerRow_;
+  }
+
+  [[nodiscard]] Word* Row(int i) {
+    return a_.get() + static_cast<size_t>(i + border_) * wordsPerRow_;
+  }
+
+  // Returns a copy of the matrix with a different border width; the new
+  // border cells are zero.
+  [[nodiscard]] BitMatrix WithBorder(int border) const {
+    BitMatrix result(n_, m_, border);
+    result.Fill(false);
+    for (int i = 0; i < n_; ++i) {
+      for (int j = 0; j < m_; ++j) {
+        result.UnsafeSet(i, j, UnsafeAt(i, j));
+      }
+    }
+    return result;
+  }
+
+ private:
+  int n_ = 0;
+  int m_ = 0;
+  int border_ = 0;
+  int wordsPerRow_ = 0;
+  std::unique_ptr<Word[]> a_;
+};
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_BIT_MATRIX_H_
@@ -0,0 +1,65 @@
+#ifndef U7_ALGORITHM_BUCKET_QUEUE_H_
+#define U7_ALGORITHM_BUCKET_QUEUE_H_
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace u7::algorithm {
+
+// A max-priority queue for priorities in [0, 2^kPriorityBits).
+//
+// Every priority has its own bucket, and the non-empty buckets are tracked by
+// a three-level bitmap, so both Push() and Pop() take O(1) time regardless of
+// the order of the priorities. The elements with equal priorities are popped
+// in the LIFO order.
+template <typename T, int kPriorityBits = 16>
+class BucketQueue {
+  static_assert(kPriorityBits >= 12 && kPriorityBits <= 18);
+
+ public:
+  static constexpr uint32_t kMaxPriority = (uint32_t{1} << kPriorityBits) - 1;
+
+  BucketQueue()
+      : buckets_(size_t{1} << kPriorityBits),
+        level1_((size_t{1} << kPriorityBits) / 64),
+        level2_((size_t{1} << kPriorityBits) / 64 / 64) {}
+
+  [[nodiscard]] bool empty() const { return top_ == 0; }
+
+  void Push(uint32_t priority, T value) {
+    buckets_[priority].push_back(value);
+    level1_[priority / 64] |= uint64_t{1} << (priority % 64);
+    level2_[priority / 4096] |= uint64_t{1} << (priority / 64 % 64);
+    top_ |= uint64_t{1} << (priority / 4096);
+  }
+
+  T Pop() {
+    const uint32_t w2 = 63 - std::countl_zero(top_);
+    const uint32_t w1 = w2 * 64 + 63 - std::countl_zero(level2_[w2]);
+    const uint32_t priority = w1 * 64 + 63 - std::countl_zero(level1_[w1]);
+    auto& bucket = buckets_[priority];
+    const T result = bucket.back();
+    bucket.pop_back();
+    if (bucket.empty()) {
+      level1_[w1] &= ~(uint64_t{1} << (priority % 64));
+      if (level1_[w1] == 0) {
+        level2_[w2] &= ~(uint64_t{1} << (w1 % 64));
+        if (level2_[w2] == 0) {
+          top_ &= ~(uint64_t{1} << w2);
+        }
+      }
+    }
+    return result;
+  }
+
+ private:
+  std::vector<std::vector<T>> buckets_;
+  std::vector<uint64_t> level1_;
+  std::vector<uint64_t> level2_;
+  uint64_t top_ = 0;
+};
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_BUCKET_QUEUE_H_
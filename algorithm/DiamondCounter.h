@@ -0,0 +1,49 @@
+#ifndef U7_ALGORITHM_DIAMOND_COUNTER_H_
+#define U7_ALGORITHM_DIAMOND_COUNTER_H_
+
+#include "algorithm/Matrix.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace u7::algorithm {
+
+// Maintains, for every cell, the number of marked cells within the hamming
+// diamond of radius r around it, saturated at `cap`.
+//
+// Marking a cell increments 2r+1 contiguous row spans, which is O(r^2) of
+// branch-free work; querying a cell is a single load. A marked cell counts
+// itself too.
+template <typename Count>
+class DiamondCounter {
+ public:
+  DiamondCounter() = default;
+
+  DiamondCounter(int n, int m, int r, Count cap)
+      : r_(r), cap_(cap), counts_(n, m, r) {
+    counts_.Fill(0);
+  }
+
+  [[nodiscard]] Count UnsafeAt(int i, int j) const {
+    return counts_.UnsafeAt(i, j);
+  }
+
+  void Mark(int i, int j) {
+    for (int di = -r_; di <= r_; ++di) {
+      const int w = r_ - std::abs(di);
+      Count* span = &counts_.UnsafeAt(i + di, j - w);
+      for (int k = 0; k <= 2 * w; ++k) {
+        span[k] = std::min<Count>(span[k] + 1, cap_);
+      }
+    }
+  }
+
+ private:
+  int r_ = 0;
+  Count cap_ = 0;
+  Matrix<Count> counts_;
+};
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_DIAMOND_COUNTER_H_
@@ -0,0 +1,23 @@
+#ifndef U7_ALGORITHM_HASH_H_
+#define U7_ALGORITHM_HASH_H_
+
+#include <cstdint>
+
+namespace u7::algorithm {
+
+// The SplitMix64 finalizer; a fast bijective 64-bit mixer.
+constexpr uint64_t Mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// Derives a seed for the given stream from the root seed.
+constexpr uint64_t DeriveSeed(uint64_t seed, uint64_t stream) {
+  return Mix64(seed ^ Mix64(stream));
+}
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_HASH_H_
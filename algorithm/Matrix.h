@@ -8,12 +8,22 @@
 
 namespace u7::algorithm {
 
+// A dense row-major matrix.
+//
+// The matrix can be surrounded by a border of the given width; the border
+// cells are addressable with indices in [-border, 0) and [n, n + border), so
+// neighbour lookups near the edges need no bounds checks.
 template <typename T>
 class Matrix {
  public:
   Matrix() = default;
 
-  Matrix(int n, int m) : n_(n), m_(m), a_(new T[static_cast<size_t>(n) * m]) {}
+  Matrix(int n, int m, int border = 0)
+      : n_(n),
+        m_(m),
+        border_(border),
+        stride_(m + 2 * border),
+        a_(new T[static_cast<size_t>(n + 2 * border) * stride_]) {}
 
   Matrix(Matrix&& rhs) noexcept = default;
 
@@ -23,22 +33,45 @@ class Matrix {
 
   [[nodiscard]] int m() const { return m_; }
 
+  [[nodiscard]] int border() const { return border_; }
+
+  // Fills the matrix, including the border.
   void Fill(const T& x) {
-    const size_t k = static_cast<size_t>(n_) * m_;
+    const size_t k = static_cast<size_t>(n_ + 2 * border_) * stride_;
     for (size_t i = 0; i < k; ++i) {
       a_[i] = x;
     }
   }
 
+  // Fills the border only.
+  void FillBorder(const T& x) {
+    for (int i = -border_; i < n_ + border_; ++i) {
+      if (i >= 0 && i < n_) {
+        for (int j = 1; j <= border_; ++j) {
+          UnsafeAt(i, -j) = x;
+          UnsafeAt(i, m_ - 1 + j) = x;
+        }
+      } else {
+        for (int j = -border_; j < m_ + border_; ++j) {
+          UnsafeAt(i, j) = x;
+        }
+      }
+    }
+  }
+
   const T& UnsafeAt(int i, int j) const {
-    return a_[static_cast<size_t>(i) * m_ + j];
+    return a_[static_cast<size_t>(i + border_) * stride_ + (j + border_)];
   }
 
-  T& UnsafeAt(int i, int j) { return a_[static_cast<size_t>(i) * m_ + j]; }
+  T& UnsafeAt(int i, int j) {
+    return a_[static_cast<size_t>(i + border_) * stride_ + (j + border_)];
+  }
 
  private:
   int n_ = 0;
   int m_ = 0;
+  int border_ = 0;
+  int stride_ = 0;
   std::unique_ptr<T[]> a_;
 };
 
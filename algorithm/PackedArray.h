@@ -0,0 +1,114 @@
+#ifndef U7_ALGORITHM_PACKED_ARRAY_H_
+#define U7_ALGORITHM_PACKED_ARRAY_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace u7::algorithm {
+
+// An array of unsigned integers stored with a width of 1, 2, 4 or 8 bytes
+// chosen at runtime, so that the values take no more memory than needed.
+class PackedArray {
+ public:
+  // Returns the narrowest width that can store the values in [0, maxValue].
+  static constexpr int WidthFor(uint64_t maxValue) {
+    if (maxValue <= UINT8_MAX) {
+      return 1;
+    }
+    if (maxValue <= UINT16_MAX) {
+      return 2;
+    }
+    if (maxValue <= UINT32_MAX) {
+      return 4;
+    }
+    return 8;
+  }
+
+  PackedArray() = default;
+
+  PackedArray(size_t size, int width)
+      : size_(size), width_(width), data_(new uint8_t[size * width]) {}
+
+  PackedArray(PackedArray&& rhs) noexcept = default;
+
+  PackedArray& operator=(PackedArray&& rhs) noexcept = default;
+
+  [[nodiscard]] size_t size() const { return size_; }
+
+  [[nodiscard]] int width() const { return width_; }
+
+  // The largest value that fits the width.
+  [[nodiscard]] uint64_t MaxValue() const {
+    return (width_ == 8 ? UINT64_MAX : (uint64_t{1} << (8 * width_)) - 1);
+  }
+
+  [[nodiscard]] size_t MemoryUsage() const { return size_ * width_; }
+
+  [[nodiscard]] uint64_t Get(size_t i) const {
+    switch (width_) {
+      case 1:
+        return data_[i];
+      case 2:
+        return Load<uint16_t>(i);
+      case 4:
+        return Load<uint32_t>(i);
+      default:
+        return Load<uint64_t>(i);
+    }
+  }
+
+  void Set(size_t i, uint64_t value) {
+    switch (width_) {
+      case 1:
+        data_[i] = static_cast<uint8_t>(value);
+        break;
+      case 2:
+        Store<uint16_t>(i, value);
+        break;
+      case 4:
+        Store<uint32_t>(i, value);
+        break;
+      default:
+        Store<uint64_t>(i, value);
+        break;
+    }
+  }
+
+  // Sets all the values to MaxValue().
+  void FillMax() { std::memset(data_.get(), 0xff, size_ * width_); }
+
+  // Returns a copy with a different width; the values equal to MaxValue()
+  // stay so, the other values must fit the new width.
+  [[nodiscard]] PackedArray WithWidth(int width) const {
+    PackedArray result(size_, width);
+    const uint64_t max = MaxValue();
+    for (size_t i = 0; i < size_; ++i) {
+      const uint64_t value = Get(i);
+      result.Set(i, (value == max ? result.MaxValue() : value));
+    }
+    return result;
+  }
+
+ private:
+  template <typename T>
+  [[nodiscard]] uint64_t Load(size_t i) const {
+    T value;
+    std::memcpy(&value, data_.get() + i * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  void Store(size_t i, uint64_t value) {
+    const T narrow = static_cast<T>(value);
+    std::memcpy(data_.get() + i * sizeof(T), &narrow, sizeof(T));
+  }
+
+  size_t size_ = 0;
+  int width_ = 1;
+  std::unique_ptr<uint8_t[]> data_;
+};
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_PACKED_ARRAY_H_
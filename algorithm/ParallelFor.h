@@ -0,0 +1,62 @@
+#ifndef U7_ALGORITHM_PARALLEL_FOR_H_
+#define U7_ALGORITHM_PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace u7::algorithm {
+
+// Returns the number of threads to use; a non-positive request means one
+// thread per hardware core.
+inline int ResolveThreads(int threads) {
+  if (threads > 0) {
+    return threads;
+  }
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Calls fn(i) for every i in [0, n) using up to `threads` threads; the calling
+// thread is one of them. The indices are handed out dynamically, so fn(i) must
+// not depend on the order of the calls. Rethrows the first exception thrown by
+// fn.
+template <typename Fn>
+void ParallelFor(size_t n, int threads, Fn&& fn) {
+  threads = static_cast<int>(
+      std::min<size_t>(ResolveThreads(threads), std::max<size_t>(n, 1)));
+  std::atomic<size_t> next = 0;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  const auto worker = [&] {
+    try {
+      for (size_t i; (i = next.fetch_add(1)) < n;) {
+        fn(i);
+      }
+    } catch (...) {
+      next = n;
+      std::lock_guard lock(errorMutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (int t = 1; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_PARALLEL_FOR_H_
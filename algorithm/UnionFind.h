@@ -0,0 +1,65 @@
+#ifndef U7_ALGORITHM_UNION_FIND_H_
+#define U7_ALGORITHM_UNION_FIND_H_
+
+#include <memory>
+#include <utility>
+
+namespace u7::algorithm {
+
+// A disjoint-set forest with path compression (path halving) and union by
+// size.
+template <typename Index>
+class UnionFind {
+ public:
+  UnionFind() = default;
+
+  explicit UnionFind(size_t n)
+      : n_(n), components_(n), parent_(new Index[n]), size_(new Index[n]) {
+    for (size_t i = 0; i < n; ++i) {
+      parent_[i] = static_cast<Index>(i);
+      size_[i] = 1;
+    }
+  }
+
+  UnionFind(UnionFind&& rhs) noexcept = default;
+
+  UnionFind& operator=(UnionFind&& rhs) noexcept = default;
+
+  [[nodiscard]] size_t size() const { return n_; }
+
+  [[nodiscard]] size_t Components() const { return components_; }
+
+  Index Find(Index x) {
+    while (parent_[x] != x) {
+      parent_[x] = parent_[parent_[x]];
+      x = parent_[x];
+    }
+    return x;
+  }
+
+  // Returns false if the elements are already in the same set.
+  bool Union(Index x, Index y) {
+    x = Find(x);
+    y = Find(y);
+    if (x == y) {
+      return false;
+    }
+    if (size_[x] < size_[y]) {
+      std::swap(x, y);
+    }
+    parent_[y] = x;
+    size_[x] += size_[y];
+    components_ -= 1;
+    return true;
+  }
+
+ private:
+  size_t n_ = 0;
+  size_t components_ = 0;
+  std::unique_ptr<Index[]> parent_;
+  std::unique_ptr<Index[]> size_;
+};
+
+}  // namespace u7::algorithm
+
+#endif  // U7_ALGORITHM_UNION_FIND_H_
@@ -0,0 +1,81 @@
+// Measures the difficulty-targeted map search against the generation of a
+// single map, and checks that the returned seed regenerates the map.
+//
+// The calibration is built once and reused for all the targets, the way the
+// game should use it; its time is printed apart.
+//
+// Usage: difficulty_bench [side [threads]]
+//
+#include "algorithm/Philox.h"
+#include "game/GameMap.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+using ::u7::algorithm::Philox4x32;
+using ::u7::game::DifficultyCalibration;
+using ::u7::game::GameMapOptions;
+using ::u7::game::GenGameMap;
+using ::u7::game::GenGameMapForDifficulty;
+using ::u7::game::GetMapDifficulty;
+using ::u7::maze::GenMazeOptions;
+
+constexpr GenMazeOptions kGenMazeOptions{
+    .noLoops = false,
+    .noSmallSquares = false,
+    .limitDensityR = 5,
+    .limitDensityThreshold = 20,
+    .pruneStubs = true,
+};
+
+constexpr GameMapOptions kGameMapOptions{.runs = true};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char** argv) {
+  const int side = (argc > 1 ? std::atoi(argv[1]) : 512);
+  const int threads = (argc > 2 ? std::atoi(argv[2]) : 0);
+  {
+    const auto start = std::chrono::steady_clock::now();
+    Philox4x32 rng(0);
+    const auto map = GenGameMap(
+        side, side, [&rng] { return static_cast<int>(rng()); },
+        kGenMazeOptions, kGameMapOptions);
+    std::printf("one map: %.3f s\n", Seconds(start));
+  }
+  const auto calibrationStart = std::chrono::steady_clock::now();
+  const DifficultyCalibration calibration(side, side, /*seed=*/1,
+                                          kGenMazeOptions, kGameMapOptions,
+                                          /*samples=*/64, threads);
+  std::printf("calibration: %.3f s\n", Seconds(calibrationStart));
+  std::printf("%8s %8s %20s %10s %8s\n", "target", "score", "seed", "seconds",
+              "replay");
+  uint64_t seed = 2;
+  for (const double target : {0.1, 0.25, 0.5, 0.75, 0.9}) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto result = GenGameMapForDifficulty(
+        calibration, seed++, {.target = target, .threads = threads});
+    const double seconds = Seconds(start);
+    Philox4x32 rng(result.seed);
+    const auto replayed = GenGameMap(
+        side, side, [&rng] { return static_cast<int>(rng()); },
+        kGenMazeOptions, kGameMapOptions);
+    const bool same = (GetMapDifficulty(*replayed).rawScore ==
+                           GetMapDifficulty(*result.map).rawScore &&
+                       replayed->GetEntranceLocation().x ==
+                           result.map->GetEntranceLocation().x &&
+                       replayed->GetEntranceLocation().y ==
+                           result.map->GetEntranceLocation().y);
+    std::printf("%8.2f %8.3f %20llu %10.3f %8s\n", target, result.score,
+                static_cast<unsigned long long>(result.seed), seconds,
+                same ? "ok" : "DIFFERS");
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Measures how many player steps per second Game and GameBatch simulate
+// with random actions at 60 steps per second.
+//
+// Usage: game_bench [players [steps [threads]]]
+//
+#include "algorithm/ParallelFor.h"
+#include "algorithm/Philox.h"
+#include "game/Game.h"
+#include "game/GameBatch.h"
+#include "game/GameMap.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using ::u7::algorithm::Philox4x32;
+using ::u7::algorithm::ResolveThreads;
+using ::u7::game::Game;
+using ::u7::game::GameBatch;
+using ::u7::game::GameMap;
+using ::u7::game::GenGameMap;
+using ::u7::maze::GenMazeOptions;
+
+constexpr GenMazeOptions kGenMazeOptions{
+    .noLoops = false,
+    .noSmallSquares = false,
+    .limitDensityR = 5,
+    .limitDensityThreshold = 20,
+    .pruneStubs = true,
+};
+
+constexpr double kStepSeconds = 1.0 / 60.0;
+
+// The actions of every step, cycled; a player holds its direction for a
+// few steps, like a person or a bot would.
+constexpr int kFrames = 256;
+
+std::vector<std::vector<uint8_t>> GenActions(size_t players) {
+  Philox4x32 rng(1);
+  std::vector<std::vector<uint8_t>> result(kFrames,
+                                           std::vector<uint8_t>(players));
+  for (size_t p = 0; p < players; ++p) {
+    uint8_t action = 0;
+    for (int f = 0; f < kFrames; ++f) {
+      if (rng() % 8 == 0) {
+        action = static_cast<uint8_t>(1 << (rng() % 4));
+        if (rng() % 4 == 0) {
+          action |= static_cast<uint8_t>(1 << (rng() % 4));
+        }
+      }
+      result[f][p] = action;
+    }
+  }
+  return result;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char** argv) {
+  const size_t players = (argc > 1 ? std::atoll(argv[1]) : 4096);
+  const int steps = (argc > 2 ? std::atoi(argv[2]) : 1000);
+  const int threads = (argc > 3 ? std::atoi(argv[3]) : 0);
+  Philox4x32 rng(0);
+  const std::shared_ptr<const GameMap> map =
+      GenGameMap<kGenMazeOptions>(1024, 1024, rng, {.runs = true});
+  const auto actions = GenActions(players);
+  std::printf("%-16s %14s\n", "engine", "steps/s");
+  {
+    std::vector<std::vector<Game::PlayerActions>> gameActions;
+    for (const auto& frame : actions) {
+      gameActions.emplace_back(frame.begin(), frame.end());
+    }
+    Game game(map, static_cast<int>(players));
+    const auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+      game.ApplyPlayerActions(gameActions[s % kFrames], kStepSeconds);
+    }
+    std::printf("%-16s %14.0f\n", "Game",
+                players * static_cast<double>(steps) / Seconds(start));
+  }
+  // One thread, and all of them if there are more.
+  std::vector<int> threadCounts = {1};
+  if (ResolveThreads(threads) > 1) {
+    threadCounts.push_back(ResolveThreads(threads));
+  }
+  for (const int t : threadCounts) {
+    GameBatch batch(map, players);
+    const auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+      batch.Step(actions[s % kFrames], kStepSeconds, t);
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "GameBatch/%d", t);
+    std::printf("%-16s %14.0f\n", name,
+                players * static_cast<double>(steps) / Seconds(start));
+  }
+  return 0;
+}
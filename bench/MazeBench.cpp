@@ -0,0 +1,136 @@
+// Measures the maze generation throughput and the peak heap usage.
+//
+// Usage: maze_bench [cells...]
+//
+#include "algorithm/Philox.h"
+#include "maze/Maze.h"
+#include "maze/TiledMaze.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using ::u7::algorithm::Philox4x32;
+using ::u7::maze::GenMaze;
+using ::u7::maze::GenMazeEngine;
+using ::u7::maze::GenMazeOptions;
+using ::u7::maze::GenMazeQueue;
+using ::u7::maze::GenTiledMaze;
+using ::u7::maze::Maze;
+
+// Every allocation is prefixed with its size, so that the heap usage can be
+// tracked.
+std::atomic<size_t> globalHeapBytes;
+std::atomic<size_t> globalPeakHeapBytes;
+
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+  void* p = std::malloc(size + kHeaderSize);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(p) = size;
+  const size_t bytes = (globalHeapBytes += size);
+  size_t peak = globalPeakHeapBytes.load();
+  while (peak < bytes &&
+         !globalPeakHeapBytes.compare_exchange_weak(peak, bytes)) {
+  }
+  return static_cast<char*>(p) + kHeaderSize;
+}
+
+void operator delete(void* p) noexcept {
+  if (p != nullptr) {
+    p = static_cast<char*>(p) - kHeaderSize;
+    globalHeapBytes -= *static_cast<size_t*>(p);
+    std::free(p);
+  }
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept { operator delete(p); }
+
+constexpr GenMazeOptions kBaseOptions{
+    .noLoops = false,
+    .noSmallSquares = false,
+    .limitDensityR = 5,
+    .limitDensityThreshold = 20,
+    .pruneStubs = true,
+};
+
+void Report(const std::string& name, int side, auto gen) {
+  const size_t baseBytes = globalHeapBytes.load();
+  globalPeakHeapBytes = baseBytes;
+  const auto start = std::chrono::steady_clock::now();
+  const Maze maze = gen();
+  const std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - start;
+  const double cells = static_cast<double>(side) * side;
+  const double peakBytes = globalPeakHeapBytes.load() - baseBytes;
+  std::printf("%-18s %12.0f %10.3f s %10.2f Mcells/s %8.2f B/cell\n",
+              name.c_str(), cells, seconds.count(),
+              cells / seconds.count() / 1e6, peakBytes / cells);
+}
+
+template <GenMazeOptions kOptions, typename RngT>
+void Bench(const std::string& name, int side) {
+  RngT rng(side);
+  Report(name, side, [&] { return GenMaze<kOptions>(side, side, rng); });
+}
+
+// Compares the per-call Mersenne Twister with the bulk Philox generator.
+template <GenMazeOptions kOptions>
+void Bench(const std::string& name, int side) {
+  Bench<kOptions, std::mt19937>(name + "/mt", side);
+  Bench<kOptions, Philox4x32>(name + "/philox", side);
+}
+
+void BenchTiled(int side, int threads) {
+  Report("tiled/" + std::to_string(threads), side, [&] {
+    return GenTiledMaze(side, side, side, kBaseOptions, {.threads = threads});
+  });
+}
+
+int main(int argc, char** argv) {
+  std::vector<double> cells;
+  for (int i = 1; i < argc; ++i) {
+    cells.push_back(std::atof(argv[i]));
+  }
+  if (cells.empty()) {
+    cells = {1 << 20, 1 << 24, 1 << 28};
+  }
+  std::printf("%-18s %12s %12s %19s %15s\n", "mode", "cells", "time",
+              "throughput", "peak memory");
+  for (double c : cells) {
+    const int side = static_cast<int>(std::sqrt(c));
+    Bench<kBaseOptions>("binary-heap", side);
+    {
+      constexpr GenMazeOptions kOptions = [] {
+        auto options = kBaseOptions;
+        options.queue = GenMazeQueue::kBucket;
+        return options;
+      }();
+      Bench<kOptions>("bucket", side);
+    }
+    {
+      constexpr GenMazeOptions kOptions = [] {
+        auto options = kBaseOptions;
+        options.engine = GenMazeEngine::kKruskal;
+        return options;
+      }();
+      Bench<kOptions>("kruskal", side);
+    }
+    BenchTiled(side, 1);
+    if (const int cores = std::thread::hardware_concurrency(); cores > 1) {
+      BenchTiled(side, cores);
+    }
+  }
+  return 0;
+}
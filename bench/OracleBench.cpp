@@ -0,0 +1,177 @@
+// Measures the build time, the memory, and the query time of the distance
+// oracle on the maps with and without loops.
+//
+// With --repair, measures OpenCell() and CloseCell() instead, and checks the
+// repaired distances to the exit against a map built from scratch.
+//
+// Usage: oracle_bench [--repair] [cells...]
+//
+#include "algorithm/Philox.h"
+#include "game/DistanceOracle.h"
+#include "game/GameMap.h"
+#include "maze/Maze.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using ::u7::algorithm::Philox4x32;
+using ::u7::game::DistanceOracle;
+using ::u7::game::GameMap;
+using ::u7::game::MakeGameMap;
+using ::u7::maze::GenMaze;
+using ::u7::maze::GenMazeOptions;
+using ::u7::maze::Maze;
+
+constexpr int kQueries = 1000;
+
+constexpr int kRepairs = 1000;
+
+// The repaired distances are checked after every this many repairs.
+constexpr int kRepairsPerCheck = 100;
+
+// The options of the game.
+constexpr GenMazeOptions kLoopsOptions{
+    .noLoops = false,
+    .noSmallSquares = false,
+    .limitDensityR = 5,
+    .limitDensityThreshold = 20,
+    .pruneStubs = true,
+};
+
+template <GenMazeOptions kOptions>
+void Bench(int side) {
+  Philox4x32 rng(side);
+  const std::shared_ptr<const GameMap> map =
+      MakeGameMap(GenMaze<kOptions>(side, side, rng));
+  auto start = std::chrono::steady_clock::now();
+  const DistanceOracle oracle(map);
+  const std::chrono::duration<double> buildSeconds =
+      std::chrono::steady_clock::now() - start;
+  std::vector<std::pair<GameMap::Location, GameMap::Location>> queries;
+  const auto randomHall = [&] {
+    while (true) {
+      const GameMap::Location loc{static_cast<int>(rng() % side),
+                                  static_cast<int>(rng() % side)};
+      if (map->IsHall(loc)) {
+        return loc;
+      }
+    }
+  };
+  while (queries.size() < kQueries) {
+    queries.emplace_back(randomHall(), randomHall());
+  }
+  size_t totalDistance = 0;
+  start = std::chrono::steady_clock::now();
+  for (const auto& [a, b] : queries) {
+    totalDistance += oracle.GetDistance(a, b);
+  }
+  const std::chrono::duration<double> querySeconds =
+      std::chrono::steady_clock::now() - start;
+  // The maps with loops get the hub labels or, past the size limit, the
+  // landmarks.
+  const char* index =
+      (oracle.IsTree() ? "tree" : oracle.HasLabels() ? "labels" : "alt");
+  std::printf("%-8s %12zu %10.3f s %8.2f B/hall %10.2f us %10zu\n", index,
+              map->GetHallCount(), buildSeconds.count(),
+              static_cast<double>(oracle.MemoryUsage()) / map->GetHallCount(),
+              querySeconds.count() / kQueries * 1e6,
+              totalDistance / kQueries);
+}
+
+// Returns the number of the halls whose distance to the exit differs from
+// the one of a map built from scratch, and adds the build time.
+size_t CountWrongDistances(const GameMap& map, double& rebuildSeconds) {
+  Maze halls(map.GetHeight(), map.GetWidth());
+  halls.Fill(false);
+  for (int y = 0; y < map.GetHeight(); ++y) {
+    for (int x = 0; x < map.GetWidth(); ++x) {
+      halls.UnsafeSet(y, x, map.IsHall({x, y}));
+    }
+  }
+  // The entrance may have been cut off from the exit.
+  const auto start = std::chrono::steady_clock::now();
+  const GameMap expected(std::move(halls), map.GetExitLocation(),
+                         map.GetExitLocation());
+  rebuildSeconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  size_t result = 0;
+  for (int y = 0; y < map.GetHeight(); ++y) {
+    for (int x = 0; x < map.GetWidth(); ++x) {
+      result += (map.GetDistanceToExit({x, y}) !=
+                 expected.GetDistanceToExit({x, y}));
+    }
+  }
+  return result;
+}
+
+template <GenMazeOptions kOptions>
+void BenchRepair(const std::string& name, int side) {
+  Philox4x32 rng(side);
+  const std::shared_ptr<GameMap> map =
+      MakeGameMap(GenMaze<kOptions>(side, side, rng));
+  const size_t halls = map->GetHallCount();
+  double repairSeconds = 0.0;
+  double rebuildSeconds = 0.0;
+  size_t wrongDistances = 0;
+  for (int i = 1; i <= kRepairs; ++i) {
+    const GameMap::Location loc{static_cast<int>(rng() % side),
+                                static_cast<int>(rng() % side)};
+    const auto start = std::chrono::steady_clock::now();
+    if (!map->IsHall(loc)) {
+      map->OpenCell(loc);
+    } else if (loc != map->GetExitLocation()) {
+      map->CloseCell(loc);
+    }
+    repairSeconds += std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if (i % kRepairsPerCheck == 0) {
+      wrongDistances += CountWrongDistances(*map, rebuildSeconds);
+    }
+  }
+  std::printf("%-8s %12zu %10.2f us %10.3f ms %12zu\n", name.c_str(), halls,
+              repairSeconds / kRepairs * 1e6,
+              rebuildSeconds / (kRepairs / kRepairsPerCheck) * 1e3,
+              wrongDistances);
+}
+
+int main(int argc, char** argv) {
+  bool repair = false;
+  std::vector<double> cells;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string_view(argv[i]) == "--repair") {
+      repair = true;
+    } else {
+      cells.push_back(std::atof(argv[i]));
+    }
+  }
+  if (cells.empty()) {
+    cells = {1 << 16, 1 << 18, 1 << 20, 1 << 22};
+  }
+  if (repair) {
+    std::printf("%-8s %12s %13s %13s %12s\n", "mode", "halls", "repair",
+                "rebuild", "wrong");
+  } else {
+    std::printf("%-8s %12s %12s %15s %13s %10s\n", "index", "halls", "build",
+                "memory", "query", "distance");
+  }
+  for (double c : cells) {
+    const int side = static_cast<int>(std::sqrt(c));
+    if (repair) {
+      BenchRepair<GenMazeOptions{}>("tree", side);
+      BenchRepair<kLoopsOptions>("loops", side);
+    } else {
+      Bench<GenMazeOptions{}>(side);
+      Bench<kLoopsOptions>(side);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+#include "game/ChunkedMap.h"
+
+#include "algorithm/Hash.h"
+#include "algorithm/Philox.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace u7::game {
+
+using ::u7::algorithm::DeriveSeed;
+using ::u7::algorithm::Philox4x32;
+using ::u7::maze::Maze;
+
+ChunkedMap::ChunkedMap(uint64_t seed, maze::GenMazeOptions options,
+                       ChunkedMapOptions chunkedOptions)
+    : seed_(seed),
+      options_(options),
+      chunkSize_(chunkedOptions.chunkSize),
+      cacheCapacity_(chunkedOptions.cacheCapacity),
+      prefetchMargin_(chunkedOptions.prefetchMargin) {
+  if (chunkSize_ < 8) {
+    throw std::runtime_error("chunk size must be at least 8");
+  }
+  if (cacheCapacity_ < 4) {
+    throw std::runtime_error("chunk cache capacity must be at least 4");
+  }
+  // Both are ports on the left side of a chunk, so they are always halls.
+  const int d = chunkedOptions.exitDistance;
+  entrance_ = Location{0, PortOf(-1, 0, true)};
+  exit_ = Location{d * chunkSize_, d * chunkSize_ + PortOf(d - 1, d, true)};
+  prefetchThread_ = std::thread([this] { PrefetchLoop(); });
+}
+
+ChunkedMap::~ChunkedMap() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  prefetchCv_.notify_one();
+  prefetchThread_.join();
+}
+
+bool ChunkedMap::IsHall(Location loc) const {
+  const int cx = ChunkOf(loc.x);
+  const int cy = ChunkOf(loc.y);
+  return GetChunk(cx, cy)->UnsafeAt(loc.y - cy * chunkSize_,
+                                    loc.x - cx * chunkSize_);
+}
+
+std::shared_ptr<const Maze> ChunkedMap::GetChunk(int cx, int cy) const {
+  const Key key = KeyOf(cx, cy);
+  {
+    std::lock_guard lock(mutex_);
+    if (auto chunk = Find(key)) {
+      return chunk;
+    }
+  }
+  auto chunk = GenChunk(cx, cy);
+  std::lock_guard lock(mutex_);
+  Insert(key, chunk);
+  return chunk;
+}
+
+std::shared_ptr<const Maze> ChunkedMap::TryGetChunk(int cx, int cy) const {
+  const Key key = KeyOf(cx, cy);
+  {
+    std::lock_guard lock(mutex_);
+    if (auto chunk = Find(key)) {
+      return chunk;
+    }
+    if (std::find(prefetchQueue_.begin(), prefetchQueue_.end(), key) !=
+        prefetchQueue_.end()) {
+      return nullptr;
+    }
+    prefetchQueue_.push_back(key);
+  }
+  prefetchCv_.notify_one();
+  return nullptr;
+}
+
+void ChunkedMap::Prefetch(Location bottomLeft, Location topRight) {
+  const ChunkArea area{
+      .left = ChunkOf(bottomLeft.x) - prefetchMargin_,
+      .bottom = ChunkOf(bottomLeft.y) - prefetchMargin_,
+      .right = ChunkOf(topRight.x) + prefetchMargin_,
+      .top = ChunkOf(topRight.y) + prefetchMargin_,
+  };
+  std::vector<std::pair<int64_t, Key>> chunks;
+  {
+    std::lock_guard lock(mutex_);
+    if (prefetchArea_ == area) {
+      return;
+    }
+    prefetchArea_ = area;
+  }
+  const int64_t cx2 = int64_t{area.left} + area.right;
+  const int64_t cy2 = int64_t{area.bottom} + area.top;
+  for (int cx = area.left; cx <= area.right; ++cx) {
+    for (int cy = area.bottom; cy <= area.top; ++cy) {
+      const int64_t dx = 2 * int64_t{cx} - cx2;
+      const int64_t dy = 2 * int64_t{cy} - cy2;
+      chunks.emplace_back(dx * dx + dy * dy, KeyOf(cx, cy));
+    }
+  }
+  // Never prefetch more than half of the cache, or the prefetched chunks
+  // would evict each other.
+  std::sort(chunks.begin(), chunks.end());
+  chunks.resize(std::min(chunks.size(), cacheCapacity_ / 2));
+  {
+    std::lock_guard lock(mutex_);
+    prefetchQueue_.clear();
+    for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+      prefetchQueue_.push_back(it->second);
+    }
+  }
+  prefetchCv_.notify_one();
+}
+
+int ChunkedMap::PortOf(int cx, int cy, bool vertical) const {
+  const uint64_t hash =
+      DeriveSeed(DeriveSeed(seed_, KeyOf(cx, cy)), (vertical ? 1 : 2));
+  return 1 + static_cast<int>(hash % (chunkSize_ - 2));
+}
+
+std::shared_ptr<const Maze> ChunkedMap::GenChunk(int cx, int cy) const {
+  const int s = chunkSize_;
+  Philox4x32 rng(DeriveSeed(DeriveSeed(seed_, KeyOf(cx, cy)), 0));
+  const Maze inner = maze::GenMaze(
+      s - 2, s - 2,
+      maze::BulkRng([&](std::span<uint32_t> out) { rng.Fill(out); }),
+      options_);
+  auto chunk = std::make_shared<Maze>(s, s, 1);
+  chunk->Fill(false);
+  for (int i = 0; i < s - 2; ++i) {
+    for (int j = 0; j < s - 2; ++j) {
+      chunk->UnsafeSet(i + 1, j + 1, inner.UnsafeAt(i, j));
+    }
+  }
+  // Carves a corridor from the port inward until it touches a hall. It
+  // joins the maze at its first contact, so it makes no small squares.
+  const auto carve = [&](int i, int j, int di, int dj) {
+    while (i >= 0 && i < s && j >= 0 && j < s) {
+      chunk->UnsafeSet(i, j, true);
+      if ((di != 1 && chunk->UnsafeAt(i - 1, j)) ||
+          (dj != 1 && chunk->UnsafeAt(i, j - 1)) ||
+          (dj != -1 && chunk->UnsafeAt(i, j + 1)) ||
+          (di != -1 && chunk->UnsafeAt(i + 1, j))) {
+        return;
+      }
+      i += di;
+      j += dj;
+    }
+  };
+  carve(PortOf(cx - 1, cy, true), 0, 0, 1);
+  carve(PortOf(cx, cy, true), s - 1, 0, -1);
+  carve(0, PortOf(cx, cy - 1, false), 1, 0);
+  carve(s - 1, PortOf(cx, cy, false), -1, 0);
+  return chunk;
+}
+
+std::shared_ptr<const Maze> ChunkedMap::Find(Key key) const {
+  const auto it = cache_.find(key);
+  if (it == cache_.end()) {
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+  return it->second.chunk;
+}
+
+void ChunkedMap::Insert(Key key, std::shared_ptr<const Maze> chunk) const {
+  if (cache_.contains(key)) {
+    return;
+  }
+  lru_.push_front(key);
+  cache_.emplace(key, Entry{std::move(chunk), lru_.begin()});
+  while (cache_.size() > cacheCapacity_) {
+    cache_.erase(lru_.back());
+    lru_.pop_back();
+  }
+}
+
+void ChunkedMap::PrefetchLoop() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    prefetchCv_.wait(lock, [&] { return stop_ || !prefetchQueue_.empty(); });
+    if (stop_) {
+      return;
+    }
+    const Key key = prefetchQueue_.back();
+    prefetchQueue_.pop_back();
+    if (Find(key)) {
+      continue;
+    }
+    lock.unlock();
+    auto chunk = GenChunk(static_cast<int32_t>(key >> 32),
+                          static_cast<int32_t>(static_cast<uint32_t>(key)));
+    lock.lock();
+    Insert(key, std::move(chunk));
+  }
+}
+
+}  // namespace u7::game
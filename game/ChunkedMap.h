@@ -0,0 +1,196 @@
+#ifndef U7_GAME_CHUNKED_MAP_H_
+#define U7_GAME_CHUNKED_MAP_H_
+
+#include "game/GameMap.h"
+#include "maze/Maze.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace u7::game {
+
+struct ChunkedMapOptions {
+  // The side of a chunk.
+  int chunkSize = 128;
+
+  // The maximum number of chunks kept in memory.
+  size_t cacheCapacity = 256;
+
+  // The number of chunks prefetched beyond the viewport in every direction.
+  int prefetchMargin = 1;
+
+  // The exit is in the chunk (exitDistance, exitDistance), while the entrance
+  // is in the chunk (0, 0).
+  int exitDistance = 4;
+};
+
+// An endless map assembled from square chunks.
+//
+// The contents of a chunk depend only on the world seed and the chunk
+// coordinates, so a chunk can be dropped and regenerated at any time. Every
+// chunk is a maze surrounded by a ring of walls; the ring has one port per
+// side, placed by a hash of the side, and the port is carved inward until it
+// reaches the maze. So the neighbouring chunks agree on their ports, and
+// the whole world is connected.
+//
+// The chunks live in a bounded LRU cache. A background thread generates the
+// chunks around the viewport ahead of time. GetChunk() generates a chunk
+// that is not ready yet synchronously, while TryGetChunk() only queues it.
+//
+// All the methods are thread-safe.
+class ChunkedMap {
+ public:
+  using Location = GameMap::Location;
+
+  class View;
+
+  ChunkedMap(uint64_t seed, maze::GenMazeOptions options,
+             ChunkedMapOptions chunkedOptions = {});
+
+  ChunkedMap(const ChunkedMap&) = delete;
+
+  ChunkedMap& operator=(const ChunkedMap&) = delete;
+
+  ~ChunkedMap();
+
+  [[nodiscard]] int GetChunkSize() const { return chunkSize_; }
+
+  [[nodiscard]] bool IsHall(Location loc) const;
+
+  // The map has no bounds, so this is the same as IsHall().
+  [[nodiscard]] bool UnsafeIsHall(Location loc) const { return IsHall(loc); }
+
+  [[nodiscard]] Location GetEntranceLocation() const { return entrance_; }
+
+  [[nodiscard]] Location GetExitLocation() const { return exit_; }
+
+  // Returns the chunk (cx, cy); it covers the locations
+  // [cx * chunkSize, (cx + 1) * chunkSize) x [cy * chunkSize, ...), and
+  // the cell (x, y) is at the row y and the column x. The maze has a border
+  // of walls.
+  [[nodiscard]] std::shared_ptr<const maze::Maze> GetChunk(int cx,
+                                                           int cy) const;
+
+  // Same as GetChunk(), but never waits for the generation: returns null
+  // if the chunk is not ready, and queues it for the background thread
+  // ahead of the prefetched chunks.
+  [[nodiscard]] std::shared_ptr<const maze::Maze> TryGetChunk(int cx,
+                                                              int cy) const;
+
+  // Schedules the chunks covering the given area, plus the margin, for
+  // the background generation; the chunks nearest to the centre go first.
+  // Cheap when the covered chunks have not changed.
+  void Prefetch(Location bottomLeft, Location topRight);
+
+  // Returns the chunk coordinate of the location coordinate.
+  [[nodiscard]] int ChunkOf(int z) const {
+    return (z >= 0 ? z / chunkSize_ : -((-z - 1) / chunkSize_) - 1);
+  }
+
+ private:
+  using Key = uint64_t;
+
+  // A rectangle of chunks, inclusive.
+  struct ChunkArea {
+    int left = 0;
+    int bottom = 0;
+    int right = -1;
+    int top = -1;
+
+    bool operator==(const ChunkArea& rhs) const = default;
+  };
+
+  struct Entry {
+    std::shared_ptr<const maze::Maze> chunk;
+    std::list<Key>::iterator lruPosition;
+  };
+
+  static Key KeyOf(int cx, int cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+           static_cast<uint32_t>(cy);
+  }
+
+  // Returns the position of the port within the side; `vertical` selects
+  // the side between (cx, cy) and (cx + 1, cy), otherwise (cx, cy + 1).
+  [[nodiscard]] int PortOf(int cx, int cy, bool vertical) const;
+
+  [[nodiscard]] std::shared_ptr<const maze::Maze> GenChunk(int cx,
+                                                           int cy) const;
+
+  // Looks the chunk up and marks it as recently used; mutex_ must be held.
+  std::shared_ptr<const maze::Maze> Find(Key key) const;
+
+  // Inserts the chunk unless it is already there; mutex_ must be held.
+  void Insert(Key key, std::shared_ptr<const maze::Maze> chunk) const;
+
+  void PrefetchLoop();
+
+  const uint64_t seed_;
+  const maze::GenMazeOptions options_;
+  const int chunkSize_;
+  const size_t cacheCapacity_;
+  const int prefetchMargin_;
+  Location entrance_;
+  Location exit_;
+
+  mutable std::mutex mutex_;
+  mutable std::list<Key> lru_;
+  mutable std::unordered_map<Key, Entry> cache_;
+
+  mutable std::condition_variable prefetchCv_;
+  mutable std::vector<Key> prefetchQueue_;  // The next chunk is at the back.
+  ChunkArea prefetchArea_;
+  bool stop_ = false;
+  std::thread prefetchThread_;
+};
+
+// The map as seen by a single reader, such as the movement of the players:
+// keeps the last two chunks it has looked at, so the probes within them,
+// also along their common side, take neither the lock nor the hash lookup.
+// A view is not thread-safe, and it pins its chunks in memory while it
+// lives.
+class ChunkedMap::View {
+ public:
+  explicit View(const ChunkedMap& map) : map_(map) {}
+
+  [[nodiscard]] bool IsHall(Location loc) const {
+    const int cx = map_.ChunkOf(loc.x);
+    const int cy = map_.ChunkOf(loc.y);
+    if (!slots_[0].chunk || slots_[0].cx != cx || slots_[0].cy != cy) {
+      std::swap(slots_[0], slots_[1]);
+      if (!slots_[0].chunk || slots_[0].cx != cx || slots_[0].cy != cy) {
+        slots_[0] = Slot{map_.GetChunk(cx, cy), cx, cy};
+      }
+    }
+    return slots_[0].chunk->UnsafeAt(loc.y - cy * map_.chunkSize_,
+                                     loc.x - cx * map_.chunkSize_);
+  }
+
+  [[nodiscard]] bool UnsafeIsHall(Location loc) const { return IsHall(loc); }
+
+  [[nodiscard]] Location GetExitLocation() const {
+    return map_.GetExitLocation();
+  }
+
+ private:
+  struct Slot {
+    std::shared_ptr<const maze::Maze> chunk;
+    int cx = 0;
+    int cy = 0;
+  };
+
+  const ChunkedMap& map_;
+  // The most recent chunk goes first.
+  mutable Slot slots_[2];
+};
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_CHUNKED_MAP_H_
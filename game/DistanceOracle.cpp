@@ -0,0 +1,571 @@
+#include "game/DistanceOracle.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace u7::game {
+
+using ::u7::algorithm::PackedArray;
+
+namespace {
+
+// Returns the nodes in the order of the nested dissection: every part of
+// the map, starting from the whole one, is split in halves at the median of
+// its longer side, and the nodes of the first half with an arc to the
+// second one, which separate the halves, are ordered before the nodes of
+// both halves.
+std::vector<uint32_t> NestedDissectionOrder(const JunctionGraph& graph) {
+  const size_t nodeCount = graph.GetNodeCount();
+  std::vector<uint32_t> nodes(nodeCount);
+  std::iota(nodes.begin(), nodes.end(), 0);
+  std::vector<uint32_t> level(nodeCount, 0);
+  // The half of the part being split that a node belongs to, or 0.
+  std::vector<uint8_t> half(nodeCount, 0);
+  struct Part {
+    size_t begin;
+    size_t end;
+    uint32_t level;
+  };
+  std::vector<Part> parts = {Part{0, nodeCount, 0}};
+  while (!parts.empty()) {
+    const Part part = parts.back();
+    parts.pop_back();
+    const auto begin = nodes.begin() + part.begin;
+    const auto end = nodes.begin() + part.end;
+    if (part.end - part.begin <= 1) {
+      std::for_each(begin, end,
+                    [&](uint32_t node) { level[node] = part.level; });
+      continue;
+    }
+    int minX = INT32_MAX;
+    int maxX = INT32_MIN;
+    int minY = INT32_MAX;
+    int maxY = INT32_MIN;
+    std::for_each(begin, end, [&](uint32_t node) {
+      const auto loc = graph.GetNodeLocation(node);
+      minX = std::min(minX, loc.x);
+      maxX = std::max(maxX, loc.x);
+      minY = std::min(minY, loc.y);
+      maxY = std::max(maxY, loc.y);
+    });
+    const bool alongX = (maxX - minX >= maxY - minY);
+    const auto mid = begin + (end - begin) / 2;
+    std::nth_element(begin, mid, end, [&](uint32_t lhs, uint32_t rhs) {
+      const auto l = graph.GetNodeLocation(lhs);
+      const auto r = graph.GetNodeLocation(rhs);
+      return (alongX ? l.x < r.x : l.y < r.y);
+    });
+    std::for_each(begin, mid, [&](uint32_t node) { half[node] = 1; });
+    std::for_each(mid, end, [&](uint32_t node) { half[node] = 2; });
+    const auto separatorEnd =
+        std::stable_partition(begin, mid, [&](uint32_t node) {
+          const auto arcs = graph.GetArcs(node);
+          return std::any_of(arcs.begin(), arcs.end(), [&](const auto& arc) {
+            return half[arc.node] == 2;
+          });
+        });
+    std::for_each(begin, end, [&](uint32_t node) { half[node] = 0; });
+    std::for_each(begin, separatorEnd,
+                  [&](uint32_t node) { level[node] = part.level; });
+    parts.push_back(Part{static_cast<size_t>(separatorEnd - nodes.begin()),
+                         static_cast<size_t>(mid - nodes.begin()),
+                         part.level + 1});
+    parts.push_back(Part{static_cast<size_t>(mid - nodes.begin()), part.end,
+                         part.level + 1});
+  }
+  std::stable_sort(nodes.begin(), nodes.end(),
+                   [&](uint32_t lhs, uint32_t rhs) {
+                     return level[lhs] < level[rhs];
+                   });
+  return nodes;
+}
+
+}  // namespace
+
+DistanceOracle::DistanceOracle(std::shared_ptr<const GameMap> map,
+                               DistanceOracleOptions options)
+    : map_(std::move(map)),
+      changeCount_(map_->GetChangeCount()),
+      activeLandmarks_(std::max(options.activeLandmarks, 1)) {
+  if (changeCount_ != 0) {
+    throw std::runtime_error("the distance oracle needs an unchanged map");
+  }
+  if (map_->GetHallCount() >= kNone) {
+    throw std::runtime_error("too many halls for the distance oracle");
+  }
+  InitTree();
+  if (!IsTree()) {
+    graph_ = map_->GetJunctionGraph();
+    if (graph_ == nullptr) {
+      graph_ = std::make_shared<JunctionGraph>(*map_);
+    }
+    if (map_->GetHallCount() <= options.maxLabelHalls) {
+      InitLabels();
+    } else {
+      InitLandmarks(std::max(options.landmarks, 1));
+    }
+  }
+}
+
+size_t DistanceOracle::GetDistance(Location a, Location b) const {
+  if (map_->GetChangeCount() != changeCount_) {
+    throw std::logic_error("the map has changed since the oracle was built");
+  }
+  if (!map_->IsHall(a) || !map_->IsHall(b)) {
+    return static_cast<size_t>(-1);
+  }
+  if (IsTree()) {
+    return TreeDistance(static_cast<uint32_t>(map_->GetHallIndex(a)),
+                        static_cast<uint32_t>(map_->GetHallIndex(b)));
+  }
+  return (HasLabels() ? LabelDistance(a, b) : AltDistance(a, b));
+}
+
+size_t DistanceOracle::MemoryUsage() const {
+  size_t result = (parent_.capacity() + jump_.capacity() + depth_.capacity() +
+                   labelHubs_.capacity()) *
+                      sizeof(uint32_t) +
+                  labelBegin_.capacity() * sizeof(uint64_t) +
+                  labelDistances_.MemoryUsage();
+  if (graph_ != nullptr) {
+    result += graph_->MemoryUsage();
+  }
+  for (const auto& landmark : landmarks_) {
+    result += landmark.MemoryUsage();
+  }
+  return result;
+}
+
+std::vector<uint32_t> DistanceOracle::Dijkstra(uint32_t source) const {
+  std::vector<uint32_t> distance(graph_->GetNodeCount(), kNone);
+  using Entry = std::pair<uint32_t, uint32_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+  distance[source] = 0;
+  queue.emplace(0, source);
+  while (!queue.empty()) {
+    const auto [d, node] = queue.top();
+    queue.pop();
+    if (distance[node] < d) {
+      continue;
+    }
+    for (const auto& arc : graph_->GetArcs(node)) {
+      if (distance[arc.node] > d + arc.length) {
+        distance[arc.node] = d + arc.length;
+        queue.emplace(d + arc.length, arc.node);
+      }
+    }
+  }
+  return distance;
+}
+
+uint64_t DistanceOracle::LandmarkDistance(
+    const PackedArray& landmark, JunctionGraph::Position position) const {
+  if (position.node != JunctionGraph::kNone) {
+    const uint64_t d = landmark.Get(position.node);
+    return (d == landmark.MaxValue() ? kNone : d);
+  }
+  // Every path to a corridor hall comes through one of the ends.
+  const auto& edge = graph_->GetEdge(position.edge);
+  const uint64_t from = landmark.Get(edge.from);
+  if (from == landmark.MaxValue()) {
+    return kNone;
+  }
+  return std::min(from + position.offset,
+                  landmark.Get(edge.to) + edge.length - position.offset);
+}
+
+void DistanceOracle::InitTree() {
+  const size_t hallCount = map_->GetHallCount();
+  parent_.assign(hallCount, kNone);
+  jump_.resize(hallCount);
+  depth_.resize(hallCount);
+  std::vector<Location> queue;
+  queue.reserve(hallCount);
+  // Every component is rooted at its first hall in the row-major order; a
+  // visited neighbour other than the parent closes a loop.
+  for (int y = 0; y < map_->GetHeight(); ++y) {
+    for (int x = 0; x < map_->GetWidth(); ++x) {
+      const Location root{x, y};
+      if (!map_->IsHall(root)) {
+        continue;
+      }
+      const auto r = static_cast<uint32_t>(map_->GetHallIndex(root));
+      if (parent_[r] != kNone) {
+        continue;
+      }
+      parent_[r] = jump_[r] = r;
+      depth_[r] = 0;
+      queue.clear();
+      queue.push_back(root);
+      for (size_t head = 0; head < queue.size(); ++head) {
+        const Location loc = queue[head];
+        const auto p = static_cast<uint32_t>(map_->GetHallIndex(loc));
+        bool loop = false;
+        ForEachNeighbour(loc, [&](Location next) {
+          const auto c = static_cast<uint32_t>(map_->GetHallIndex(next));
+          if (parent_[c] != kNone) {
+            loop |= (c != parent_[p]);
+            return;
+          }
+          // The jump pointers form a skew-binary decomposition of the path
+          // to the root.
+          const uint32_t j = jump_[p];
+          parent_[c] = p;
+          depth_[c] = depth_[p] + 1;
+          jump_[c] = (depth_[p] - depth_[j] == depth_[j] - depth_[jump_[j]]
+                          ? jump_[j]
+                          : p);
+          queue.push_back(next);
+        });
+        if (loop) {
+          parent_ = std::vector<uint32_t>();
+          jump_ = std::vector<uint32_t>();
+          depth_ = std::vector<uint32_t>();
+          return;
+        }
+      }
+    }
+  }
+}
+
+void DistanceOracle::InitLabels() {
+  const std::vector<uint32_t> order = NestedDissectionOrder(*graph_);
+  const size_t nodeCount = order.size();
+  // The search from a node does not label, nor expand, a node whose
+  // distance is already given by the labels found so far; the labels grow
+  // in the order of the hubs.
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> labels(nodeCount);
+  // The labels of the node the search starts from, by the hubs.
+  std::vector<uint32_t> rootDistance(nodeCount, kNone);
+  std::vector<uint32_t> distance(nodeCount, kNone);
+  std::vector<uint32_t> reached;
+  using Entry = std::pair<uint32_t, uint32_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+  uint32_t maxDistance = 0;
+  for (uint32_t hub = 0; hub < nodeCount; ++hub) {
+    const uint32_t root = order[hub];
+    for (const auto& [h, d] : labels[root]) {
+      rootDistance[h] = d;
+    }
+    distance[root] = 0;
+    reached.push_back(root);
+    queue.emplace(0, root);
+    while (!queue.empty()) {
+      const auto [d, node] = queue.top();
+      queue.pop();
+      if (distance[node] < d) {
+        continue;
+      }
+      const auto& label = labels[node];
+      if (std::any_of(label.begin(), label.end(), [&](const auto& entry) {
+            return rootDistance[entry.first] != kNone &&
+                   rootDistance[entry.first] + entry.second <= d;
+          })) {
+        continue;
+      }
+      labels[node].emplace_back(hub, d);
+      maxDistance = std::max(maxDistance, d);
+      for (const auto& arc : graph_->GetArcs(node)) {
+        if (distance[arc.node] > d + arc.length) {
+          if (distance[arc.node] == kNone) {
+            reached.push_back(arc.node);
+          }
+          distance[arc.node] = d + arc.length;
+          queue.emplace(d + arc.length, arc.node);
+        }
+      }
+    }
+    for (const uint32_t node : reached) {
+      distance[node] = kNone;
+    }
+    reached.clear();
+    for (const auto& [h, d] : labels[root]) {
+      rootDistance[h] = kNone;
+    }
+  }
+  labelBegin_.resize(nodeCount + 1);
+  labelBegin_[0] = 0;
+  for (size_t node = 0; node < nodeCount; ++node) {
+    labelBegin_[node + 1] = labelBegin_[node] + labels[node].size();
+  }
+  labelHubs_.resize(labelBegin_.back());
+  labelDistances_ =
+      PackedArray(labelBegin_.back(), PackedArray::WidthFor(maxDistance));
+  for (size_t node = 0; node < nodeCount; ++node) {
+    uint64_t i = labelBegin_[node];
+    for (const auto& [h, d] : labels[node]) {
+      labelHubs_[i] = h;
+      labelDistances_.Set(i++, d);
+    }
+    labels[node] = {};
+  }
+}
+
+void DistanceOracle::InitLandmarks(int landmarks) {
+  // The farthest-point selection: the first landmark is next to the exit,
+  // and every next one is the node farthest from the landmarks chosen so
+  // far. Only the component of the exit gets landmarks.
+  const JunctionGraph::Position exit =
+      graph_->GetPosition(*map_, map_->GetExitLocation());
+  uint32_t next = (exit.node != JunctionGraph::kNone
+                       ? exit.node
+                       : graph_->GetEdge(exit.edge).from);
+  std::vector<uint32_t> minDistance(graph_->GetNodeCount(), kNone);
+  for (int l = 0; l < landmarks; ++l) {
+    const std::vector<uint32_t> distance = Dijkstra(next);
+    uint32_t maxDistance = 0;
+    uint32_t farthestDistance = 0;
+    for (uint32_t node = 0; node < distance.size(); ++node) {
+      if (distance[node] == kNone) {
+        continue;
+      }
+      maxDistance = std::max(maxDistance, distance[node]);
+      minDistance[node] = std::min(minDistance[node], distance[node]);
+      if (farthestDistance < minDistance[node]) {
+        farthestDistance = minDistance[node];
+        next = node;
+      }
+    }
+    PackedArray landmark(distance.size(),
+                         PackedArray::WidthFor(uint64_t{maxDistance} + 1));
+    for (size_t node = 0; node < distance.size(); ++node) {
+      landmark.Set(node, (distance[node] == kNone ? landmark.MaxValue()
+                                                  : distance[node]));
+    }
+    landmarks_.push_back(std::move(landmark));
+    if (farthestDistance == 0) {
+      break;
+    }
+  }
+}
+
+size_t DistanceOracle::TreeDistance(uint32_t a, uint32_t b) const {
+  const uint32_t depthA = depth_[a];
+  const uint32_t depthB = depth_[b];
+  if (depth_[a] < depth_[b]) {
+    std::swap(a, b);
+  }
+  while (depth_[a] > depth_[b]) {
+    a = (depth_[jump_[a]] >= depth_[b] ? jump_[a] : parent_[a]);
+  }
+  // The jump pointers depend only on the depth, so a and b jump together.
+  while (a != b) {
+    if (depth_[a] == 0) {
+      return static_cast<size_t>(-1);
+    }
+    if (jump_[a] != jump_[b]) {
+      a = jump_[a];
+      b = jump_[b];
+    } else {
+      a = parent_[a];
+      b = parent_[b];
+    }
+  }
+  return size_t{depthA} + depthB - 2 * size_t{depth_[a]};
+}
+
+uint64_t DistanceOracle::NodeDistance(uint32_t a, uint32_t b) const {
+  uint64_t result = kNone;
+  uint64_t i = labelBegin_[a];
+  uint64_t j = labelBegin_[b];
+  const uint64_t iEnd = labelBegin_[a + 1];
+  const uint64_t jEnd = labelBegin_[b + 1];
+  while (i < iEnd && j < jEnd) {
+    if (labelHubs_[i] < labelHubs_[j]) {
+      ++i;
+    } else if (labelHubs_[j] < labelHubs_[i]) {
+      ++j;
+    } else {
+      result = std::min(result, labelDistances_.Get(i++) +
+                                    labelDistances_.Get(j++));
+    }
+  }
+  return result;
+}
+
+size_t DistanceOracle::LabelDistance(Location a, Location b) const {
+  // The ends of the position: the node, or both ends of the corridor, and
+  // the distances to them. Every path from a corridor hall leaves through
+  // one of its ends.
+  struct End {
+    uint32_t node;
+    uint64_t distance;
+  };
+  const auto getEnds = [&](JunctionGraph::Position position,
+                           std::array<End, 2>& ends) -> size_t {
+    if (position.node != JunctionGraph::kNone) {
+      ends[0] = End{position.node, 0};
+      return 1;
+    }
+    const auto& edge = graph_->GetEdge(position.edge);
+    ends[0] = End{edge.from, position.offset};
+    ends[1] = End{edge.to, edge.length - position.offset};
+    return 2;
+  };
+  const JunctionGraph::Position source = graph_->GetPosition(*map_, a);
+  const JunctionGraph::Position target = graph_->GetPosition(*map_, b);
+  uint64_t result = kNone;
+  // The two halls of a corridor are also connected along it.
+  if (source.edge != JunctionGraph::kNone && source.edge == target.edge) {
+    result = (source.offset > target.offset ? source.offset - target.offset
+                                            : target.offset - source.offset);
+  }
+  std::array<End, 2> sourceEnds;
+  std::array<End, 2> targetEnds;
+  const size_t sourceEndCount = getEnds(source, sourceEnds);
+  const size_t targetEndCount = getEnds(target, targetEnds);
+  for (size_t i = 0; i < sourceEndCount; ++i) {
+    for (size_t j = 0; j < targetEndCount; ++j) {
+      const uint64_t distance =
+          NodeDistance(sourceEnds[i].node, targetEnds[j].node);
+      if (distance != kNone) {
+        result = std::min(result, sourceEnds[i].distance + distance +
+                                      targetEnds[j].distance);
+      }
+    }
+  }
+  return (result == kNone ? static_cast<size_t>(-1) : result);
+}
+
+size_t DistanceOracle::AltDistance(Location a, Location b) const {
+  const JunctionGraph::Position source = graph_->GetPosition(*map_, a);
+  const JunctionGraph::Position target = graph_->GetPosition(*map_, b);
+  // Only the landmarks with the best bounds at the source take part; a
+  // landmark that reaches only one of the halls proves that there is no
+  // path.
+  std::vector<std::pair<uint64_t, const PackedArray*>> bounds;
+  uint64_t f0 = 0;
+  for (const auto& landmark : landmarks_) {
+    const uint64_t ds = LandmarkDistance(landmark, source);
+    const uint64_t dt = LandmarkDistance(landmark, target);
+    if ((ds == kNone) != (dt == kNone)) {
+      return static_cast<size_t>(-1);
+    }
+    if (dt != kNone) {
+      bounds.emplace_back((ds > dt ? ds - dt : dt - ds), &landmark);
+      f0 = std::max(f0, bounds.back().first);
+    }
+  }
+  const size_t active = std::min<size_t>(bounds.size(), activeLandmarks_);
+  std::partial_sort(bounds.begin(), bounds.begin() + active, bounds.end(),
+                    [](const auto& lhs, const auto& rhs) {
+                      return lhs.first > rhs.first;
+                    });
+  bounds.resize(active);
+  for (auto& [dt, landmark] : bounds) {
+    dt = LandmarkDistance(*landmark, target);
+  }
+  const auto heuristic = [&](uint32_t node) {
+    uint64_t result = 0;
+    for (const auto& [dt, landmark] : bounds) {
+      const uint64_t d = landmark->Get(node);
+      result = std::max(result, (d > dt ? d - dt : dt - d));
+    }
+    return result;
+  };
+  // The search starts from the ends of the source corridor and finishes at
+  // the ends of the target one.
+  std::pair<uint32_t, uint32_t> starts[2];
+  std::pair<uint32_t, uint32_t> finishes[2];
+  const auto ends = [&](JunctionGraph::Position position,
+                        std::pair<uint32_t, uint32_t>(&out)[2]) {
+    if (position.node != JunctionGraph::kNone) {
+      out[0] = out[1] = {position.node, 0};
+    } else {
+      const auto& edge = graph_->GetEdge(position.edge);
+      out[0] = {edge.from, position.offset};
+      out[1] = {edge.to, edge.length - position.offset};
+    }
+  };
+  ends(source, starts);
+  ends(target, finishes);
+  uint64_t result = kNone;
+  if (source.node != JunctionGraph::kNone && source.node == target.node) {
+    return 0;
+  }
+  if (source.edge != JunctionGraph::kNone && source.edge == target.edge) {
+    result = (source.offset > target.offset ? source.offset - target.offset
+                                            : target.offset - source.offset);
+  }
+  // A* with a consistent heuristic, so a node is final once popped. The
+  // buckets pop in the LIFO order, which prefers the deeper nodes among the
+  // ones with equal f.
+  auto scratch = AcquireScratch();
+  if (++scratch->stamp == 0) {
+    std::fill(scratch->best.begin(), scratch->best.end(), 0);
+    scratch->stamp = 1;
+  }
+  const uint64_t stamp = uint64_t{scratch->stamp} << 32;
+  auto& best = scratch->best;
+  auto& buckets = scratch->buckets;
+  const auto g = [&](uint32_t node) {
+    return (best[node] >> 32 == stamp >> 32 ? static_cast<uint32_t>(best[node])
+                                            : kNone);
+  };
+  const auto push = [&](uint32_t node, uint64_t d) {
+    if (g(node) > d) {
+      best[node] = stamp | d;
+      const size_t bucket = d + heuristic(node) - f0;
+      if (bucket >= buckets.size()) {
+        buckets.resize(bucket + 1);
+      }
+      buckets[bucket].push_back(node);
+    }
+  };
+  for (const auto& [node, d] : starts) {
+    push(node, d);
+  }
+  for (size_t bucket = 0; bucket < buckets.size() && f0 + bucket < result;
+       ++bucket) {
+    // Not a reference: pushing to the later buckets may grow the vector.
+    while (!buckets[bucket].empty()) {
+      const uint32_t node = buckets[bucket].back();
+      buckets[bucket].pop_back();
+      const uint64_t d = g(node);
+      if (d + heuristic(node) - f0 != bucket) {
+        continue;  // Superseded by a shorter path.
+      }
+      for (const auto& [finish, rest] : finishes) {
+        if (finish == node) {
+          result = std::min(result, d + rest);
+        }
+      }
+      for (const auto& arc : graph_->GetArcs(node)) {
+        push(arc.node, d + arc.length);
+      }
+    }
+  }
+  for (auto& open : buckets) {
+    open.clear();
+  }
+  ReleaseScratch(std::move(scratch));
+  return (result == kNone ? static_cast<size_t>(-1) : result);
+}
+
+std::unique_ptr<DistanceOracle::Scratch> DistanceOracle::AcquireScratch()
+    const {
+  {
+    std::lock_guard lock(scratchMutex_);
+    if (!scratchPool_.empty()) {
+      auto scratch = std::move(scratchPool_.back());
+      scratchPool_.pop_back();
+      return scratch;
+    }
+  }
+  auto scratch = std::make_unique<Scratch>();
+  scratch->best.resize(graph_->GetNodeCount());
+  scratch->buckets.resize(1);
+  return scratch;
+}
+
+void DistanceOracle::ReleaseScratch(std::unique_ptr<Scratch> scratch) const {
+  std::lock_guard lock(scratchMutex_);
+  scratchPool_.push_back(std::move(scratch));
+}
+
+}  // namespace u7::game
@@ -0,0 +1,179 @@
+#ifndef U7_GAME_DISTANCE_ORACLE_H_
+#define U7_GAME_DISTANCE_ORACLE_H_
+
+#include "algorithm/PackedArray.h"
+#include "game/GameMap.h"
+#include "game/JunctionGraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace u7::game {
+
+struct DistanceOracleOptions {
+  // The maps with loops of up to this many halls get the hub labels, and
+  // the larger ones the landmarks.
+  size_t maxLabelHalls = 1 << 17;
+
+  // The number of landmarks for the maps with loops past maxLabelHalls.
+  int landmarks = 16;
+
+  // The number of the landmarks with the best bounds that a query uses.
+  int activeLandmarks = 4;
+};
+
+// Answers the shortest path distance between any two halls of a map.
+//
+// If the map has no loops, the halls form a forest, and the distance is
+// depth(a) + depth(b) - 2 depth(lca(a, b)). The lowest common ancestor is
+// found with the skew-binary jump pointers (Myers, "An applicative random
+// access stack"): every hall keeps its parent, its depth, and one jump
+// pointer, so the index takes 12 bytes per hall and a query takes
+// O(log depth) steps.
+//
+// Otherwise, every node of the JunctionGraph of the map keeps a hub label:
+// the distances to some of the nodes, its hubs, chosen so that every
+// shortest path between two nodes passes through a hub of both. A query
+// merges the labels of the two halls, ordered by the hubs, in time linear in
+// their size. The labels are built by the pruned Dijkstra searches (Akiba
+// et al., "Fast exact shortest-path distance queries on large networks by
+// pruned landmark labeling") from the nodes in the order of a nested
+// dissection of the map: the nodes that split the map in halves along its
+// longer side come first, then the ones that split the halves, and so on.
+//
+// A corridor hall takes the hubs of both ends of its corridor.
+//
+// The mazes are grid-like, with about one independent loop for every five
+// halls, so the labels grow as the square root of the nodes, and their
+// build as the power 1.5 of them. On the mazes of the game, the labels take
+// 125 bytes per hall at 128x128 and 360 at 512x512, the build takes 0.02 s
+// and 2.2 s, and a query 1 and 3 us; at 1024x1024, they would take 700
+// bytes per hall and 27 s.
+//
+// So the maps with more than maxLabelHalls halls, about a 570x570 maze of
+// the game, run A* with the ALT heuristic (Goldberg and Harrelson,
+// "Computing the shortest path: A* search meets graph theory") on the
+// junction graph instead. The distances from a few landmark nodes, placed
+// by the farthest-point selection, bound the remaining distance by the
+// triangle inequality. The index takes 2 or 4 bytes per node and landmark,
+// and is built in a few Dijkstra runs, but a query searches a part of the
+// graph: 40 us at 256x256, 1 ms at 1024x1024, and 4 ms at 2048x2048.
+//
+// The map must not have been changed by GameMap::OpenCell() or CloseCell(),
+// whose halls GameMap::GetHallIndex() does not number; after a change, the
+// queries throw, and the oracle has to be built on a new GameMap of the
+// changed halls.
+//
+// The queries are thread-safe.
+class DistanceOracle {
+ public:
+  using Location = GameMap::Location;
+
+  explicit DistanceOracle(std::shared_ptr<const GameMap> map,
+                          DistanceOracleOptions options = {});
+
+  [[nodiscard]] const GameMap& GetGameMap() const { return *map_; }
+
+  // Whether the map has no loops, so the exact tree index is used.
+  [[nodiscard]] bool IsTree() const { return !depth_.empty(); }
+
+  // Whether the map has loops and the hub labels are used.
+  [[nodiscard]] bool HasLabels() const { return !labelBegin_.empty(); }
+
+  // Returns the length of the shortest path between the locations, or
+  // size_t(-1) if either of them is a wall or there is no path. Throws
+  // std::logic_error if the map has changed since the oracle was built.
+  [[nodiscard]] size_t GetDistance(Location a, Location b) const;
+
+  // The memory taken by the index.
+  [[nodiscard]] size_t MemoryUsage() const;
+
+ private:
+  // Marks no hall, no path, and the unreachable landmarks.
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  // Returns the neighbouring halls of the location.
+  template <typename Fn>
+  void ForEachNeighbour(Location loc, Fn&& fn) const {
+    for (const Location next :
+         {loc.Up(), loc.Down(), loc.Left(), loc.Right()}) {
+      if (map_->IsHall(next)) {
+        fn(next);
+      }
+    }
+  }
+
+  // Runs Dijkstra on the junction graph and returns the distances of all
+  // the nodes, with kNone for the unreachable ones.
+  [[nodiscard]] std::vector<uint32_t> Dijkstra(uint32_t source) const;
+
+  // Returns the distance from the landmark to the hall, or kNone.
+  [[nodiscard]] uint64_t LandmarkDistance(
+      const algorithm::PackedArray& landmark,
+      JunctionGraph::Position position) const;
+
+  void InitTree();
+
+  void InitLabels();
+
+  void InitLandmarks(int landmarks);
+
+  [[nodiscard]] size_t TreeDistance(uint32_t a, uint32_t b) const;
+
+  // Returns the distance between the nodes, or kNone; merges their labels.
+  [[nodiscard]] uint64_t NodeDistance(uint32_t a, uint32_t b) const;
+
+  [[nodiscard]] size_t LabelDistance(Location a, Location b) const;
+
+  [[nodiscard]] size_t AltDistance(Location a, Location b) const;
+
+  // The working memory of an ALT query.
+  struct Scratch {
+    // The best known distance of a node in the low half and the query
+    // stamp in the high half; stale stamps mean the node is not reached.
+    std::vector<uint64_t> best;
+    uint32_t stamp = 0;
+
+    // The open nodes by f - f(source); f never decreases.
+    std::vector<std::vector<uint32_t>> buckets;
+  };
+
+  [[nodiscard]] std::unique_ptr<Scratch> AcquireScratch() const;
+
+  void ReleaseScratch(std::unique_ptr<Scratch> scratch) const;
+
+  std::shared_ptr<const GameMap> map_;
+
+  // GameMap::GetChangeCount() of the map the index was built on.
+  uint64_t changeCount_ = 0;
+
+  // The forest index; empty if the map has loops.
+  std::vector<uint32_t> parent_;
+  std::vector<uint32_t> jump_;
+  std::vector<uint32_t> depth_;
+
+  // The junction graph if the map has loops.
+  std::shared_ptr<const JunctionGraph> graph_;
+
+  // The labels of the nodes: the label of a node is [labelBegin_[node],
+  // labelBegin_[node + 1]) of the hubs, by their order, and of the
+  // distances; empty unless the hub labels are used.
+  std::vector<uint64_t> labelBegin_;
+  std::vector<uint32_t> labelHubs_;
+  algorithm::PackedArray labelDistances_;
+
+  // The distances from every landmark to the nodes; empty unless the
+  // landmarks are used.
+  std::vector<algorithm::PackedArray> landmarks_;
+  int activeLandmarks_ = 0;
+
+  mutable std::mutex scratchMutex_;
+  mutable std::vector<std::unique_ptr<Scratch>> scratchPool_;
+};
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_DISTANCE_ORACLE_H_
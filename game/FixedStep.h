@@ -0,0 +1,81 @@
+#ifndef U7_GAME_FIXED_STEP_H_
+#define U7_GAME_FIXED_STEP_H_
+
+#include "game/Game.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace u7::game {
+
+struct FixedStepOptions {
+  // The simulated time of a tick.
+  double tickSeconds = 1.0 / 120.0;
+
+  // The most time simulated at once; a longer stall is dropped rather than
+  // caught up with.
+  double maxCatchUpSeconds = 0.25;
+};
+
+// Turns the frame times into whole simulation ticks of the same length, so
+// the simulation does not depend on the frame rate, and the same actions
+// every tick give bit-identical results.
+//
+//   for (int ticks = step.Advance(frameSeconds); ticks > 0; --ticks) {
+//     previous = game.GetPlayerState().location;
+//     game.ApplyPlayerActions(0, actions, step.GetTickSeconds());
+//   }
+//   Draw(Interpolate(previous, game.GetPlayerState().location,
+//                    step.GetAlpha()));
+class FixedStep {
+ public:
+  explicit FixedStep(FixedStepOptions options = {})
+      : tickSeconds_(options.tickSeconds),
+        maxTicks_(std::max(
+            1, static_cast<int>(options.maxCatchUpSeconds / tickSeconds_))) {}
+
+  [[nodiscard]] double GetTickSeconds() const { return tickSeconds_; }
+
+  // The number of the ticks returned by Advance() so far.
+  [[nodiscard]] uint64_t GetTick() const { return tick_; }
+
+  // The time since the last tick as a fraction of a tick, in [0, 1).
+  [[nodiscard]] double GetAlpha() const {
+    return std::clamp(accumulator_ / tickSeconds_, 0.0, 1.0);
+  }
+
+  // Adds the time that has passed and returns the number of the ticks to
+  // simulate now; the ticks beyond the catch-up budget are dropped.
+  int Advance(double seconds) {
+    accumulator_ += std::max(seconds, 0.0);
+    const double wholeTicks = std::floor(accumulator_ / tickSeconds_);
+    accumulator_ = std::max(0.0, accumulator_ - wholeTicks * tickSeconds_);
+    const int ticks = static_cast<int>(std::min<double>(wholeTicks, maxTicks_));
+    tick_ += ticks;
+    return ticks;
+  }
+
+  // Drops the time accumulated since the last tick.
+  void Reset() { accumulator_ = 0.0; }
+
+ private:
+  double tickSeconds_;
+  int maxTicks_;
+  double accumulator_ = 0.0;
+  uint64_t tick_ = 0;
+};
+
+// Returns the location between the previous and the current ones.
+inline Game::Location Interpolate(const Game::Location& previous,
+                                  const Game::Location& current,
+                                  double alpha) {
+  Game::Location result;
+  result.x = previous.x + (current.x - previous.x) * alpha;
+  result.y = previous.y + (current.y - previous.y) * alpha;
+  return result;
+}
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_FIXED_STEP_H_
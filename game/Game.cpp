@@ -3,177 +3,173 @@
 //
 #include "game/Game.h"
 
+#include "game/Movement.h"
+
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
 
 namespace u7::game {
 namespace {
 
-constexpr double kEps = 1.0 / 1024.0;
-constexpr double kBaseSpeed = 2.0;
-constexpr double kAcceleration = 15.0;
-
+template <typename Map>
 Game::PlayerState NormalizePlayerState(Game::PlayerState playerState,
-                                       const GameMap& map) {
-  const GameMap::Location mapLoc = {
-      static_cast<int>(std::round(playerState.location.x)),
-      static_cast<int>(std::round(playerState.location.y)),
-  };
-  if (!map.IsHall(mapLoc)) {
-    throw std::logic_error("player has stuck in the wall");
-  }
-  if ((playerState.location.y > mapLoc.y && !map.IsHall(mapLoc.Up())) ||
-      (playerState.location.y < mapLoc.y && !map.IsHall(mapLoc.Down()))) {
-    playerState.location.y = mapLoc.y;
-  }
-  if ((playerState.location.x > mapLoc.x && !map.IsHall(mapLoc.Right())) ||
-      (playerState.location.x < mapLoc.x && !map.IsHall(mapLoc.Left()))) {
-    playerState.location.x = mapLoc.x;
-  }
-  if (std::fabs(playerState.location.x - mapLoc.x) < kEps &&
-      std::fabs(playerState.location.y - mapLoc.y) < kEps &&
-      map.GetExitLocation() == mapLoc) {
+                                       const Map& map) {
+  if (movement::NormalizeLocation(map, playerState.location.x,
+                                  playerState.location.y)) {
     playerState.touchedExit = true;
   }
   return playerState;
 }
 
-}  // namespace
-
-Game::Game(std::shared_ptr<const GameMap> map) : map_(std::move(map)) {
-  playerState_.location.x = map_->GetEntranceLocation().x;
-  playerState_.location.y = map_->GetEntranceLocation().y;
-  playerState_ = NormalizePlayerState(playerState_, *map_);
+template <typename Map>
+Game::PlayerState MovePlayer(Game::PlayerState playerState, const Map& map,
+                             Game::PlayerActions actions, double seconds) {
+  const double reachableDistance =
+      movement::Accelerate(playerState.speed, seconds);
+  playerState.ask1 = (actions & Game::kPlayerAsk1).any();
+  playerState.ask2 = (actions & Game::kPlayerAsk2).any();
+  if (!movement::MoveAlong(map, actions & Game::kPlayerGoMask,
+                           playerState.location.x, playerState.location.y,
+                           reachableDistance)) {
+    playerState.speed = 0.0;
+  }
+  return NormalizePlayerState(playerState, map);
 }
 
-void Game::ApplyPlayerActions(PlayerActions actions, double seconds) {
-  playerState_.speed = std::max(playerState_.speed, kBaseSpeed);
-  double reachableDistance =
-      playerState_.speed * seconds + kAcceleration * seconds * seconds / 2.0;
-  playerState_.speed += kAcceleration * seconds;
-  const auto goTo = [&](Location nextLoc) {
-    const double dx = nextLoc.x - playerState_.location.x;
-    const double dy = nextLoc.y - playerState_.location.y;
-    const double distance = std::fabs(dx) + std::fabs(dy);
-    if (distance <= reachableDistance) {
-      playerState_.location = nextLoc;
-      reachableDistance -= distance;
-    } else {
-      playerState_.location.x += dx * reachableDistance / distance;
-      playerState_.location.y += dy * reachableDistance / distance;
-      reachableDistance = 0.0;
-    }
-  };
+// Two players are together when they are closer than this along both axes.
+constexpr double kMeetDistance = 0.5;
 
-  playerState_.ask1 = (actions & kPlayerAsk1).any();
-  playerState_.ask2 = (actions & kPlayerAsk2).any();
-
-  while (reachableDistance > kEps) {
-    const GameMap::Location loc = {
-        static_cast<int>(std::round(playerState_.location.x)),
-        static_cast<int>(std::round(playerState_.location.y)),
-    };
-    const double fx = playerState_.location.x - loc.x;
-    const double fy = playerState_.location.y - loc.y;
-    Location nextLoc = playerState_.location;
-
-    const auto goActions = actions & kPlayerGoMask;
-    if (goActions == kPlayerGoUp) {
-      if (std::fabs(fx) < kEps) {
-        if (fy <= -kEps) {
-          nextLoc = loc;
-        } else if (map_->IsHall(loc.Up())) {
-          nextLoc = loc.Up();
-        }
-      } else if (map_->IsHall(loc.Up())) {
-        nextLoc = loc;
+// The players by the halls they are nearest to: a hash of the halls to their
+// first player, and the other players of a hall chained through next_.
+class PlayerGrid {
+ public:
+  explicit PlayerGrid(std::span<const Game::PlayerState> playerStates)
+      : playerStates_(playerStates), next_(playerStates.size(), -1) {
+    heads_.reserve(playerStates.size());
+    for (int i = 0; i < static_cast<int>(playerStates.size()); ++i) {
+      const auto [it, inserted] =
+          heads_.try_emplace(HallKey(HallOf(playerStates[i].location)), i);
+      if (!inserted) {
+        next_[i] = std::exchange(it->second, i);
       }
-    } else if (goActions == kPlayerGoDown) {
-      if (std::fabs(fx) < kEps) {
-        if (fy >= kEps) {
-          nextLoc = loc;
-        } else if (map_->IsHall(loc.Down())) {
-          nextLoc = loc.Down();
-        }
-      } else if (map_->IsHall(loc.Down())) {
-        nextLoc = loc;
-      }
-    } else if (goActions == kPlayerGoLeft) {
-      if (std::fabs(fy) < kEps) {
-        if (fx >= kEps) {
-          nextLoc = loc;
-        } else if (map_->IsHall(loc.Left())) {
-          nextLoc = loc.Left();
+    }
+  }
+
+  // Returns whether another player is together with the given one. The
+  // halls of two players together are at most one step apart along each
+  // axis.
+  [[nodiscard]] bool HasCompany(int player) const {
+    const auto& location = playerStates_[player].location;
+    const auto hall = HallOf(location);
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        const auto it = heads_.find(HallKey({hall.x + dx, hall.y + dy}));
+        if (it == heads_.end()) {
+          continue;
         }
-      } else if (map_->IsHall(loc.Left())) {
-        nextLoc = loc;
-      }
-    } else if (goActions == kPlayerGoRight) {
-      if (std::fabs(fy) < kEps) {
-        if (fx <= -kEps) {
-          nextLoc = loc;
-        } else if (map_->IsHall(loc.Right())) {
-          nextLoc = loc.Right();
+        for (int other = it->second; other != -1; other = next_[other]) {
+          const auto& otherLocation = playerStates_[other].location;
+          if (other != player &&
+              std::fabs(location.x - otherLocation.x) < kMeetDistance &&
+              std::fabs(location.y - otherLocation.y) < kMeetDistance) {
+            return true;
+          }
         }
-      } else if (map_->IsHall(loc.Right())) {
-        nextLoc = loc;
-      }
-    } else if (goActions == (kPlayerGoUp | kPlayerGoRight)) {
-      if (fx <= -kEps || fy <= -kEps) {
-        nextLoc = loc;
-      } else if (fy >= kEps) {
-        nextLoc = loc.Up();
-      } else if (fx >= kEps) {
-        nextLoc = loc.Right();
-      } else if (map_->IsHall(loc.Up()) && !map_->IsHall(loc.Right())) {
-        nextLoc = loc.Up();
-      } else if (!map_->IsHall(loc.Up()) && map_->IsHall(loc.Right())) {
-        nextLoc = loc.Right();
-      }
-    } else if (goActions == (kPlayerGoUp | kPlayerGoLeft)) {
-      if (fx >= kEps || fy <= -kEps) {
-        nextLoc = loc;
-      } else if (fy >= kEps) {
-        nextLoc = loc.Up();
-      } else if (fx <= -kEps) {
-        nextLoc = loc.Left();
-      } else if (map_->IsHall(loc.Up()) && !map_->IsHall(loc.Left())) {
-        nextLoc = loc.Up();
-      } else if (!map_->IsHall(loc.Up()) && map_->IsHall(loc.Left())) {
-        nextLoc = loc.Left();
-      }
-    } else if (goActions == (kPlayerGoDown | kPlayerGoRight)) {
-      if (fx <= -kEps || fy >= kEps) {
-        nextLoc = loc;
-      } else if (fy <= -kEps) {
-        nextLoc = loc.Down();
-      } else if (fx >= kEps) {
-        nextLoc = loc.Right();
-      } else if (map_->IsHall(loc.Down()) && !map_->IsHall(loc.Right())) {
-        nextLoc = loc.Down();
-      } else if (!map_->IsHall(loc.Down()) && map_->IsHall(loc.Right())) {
-        nextLoc = loc.Right();
-      }
-    } else if (goActions == (kPlayerGoDown | kPlayerGoLeft)) {
-      if (fx >= kEps || fy >= kEps) {
-        nextLoc = loc;
-      } else if (fy <= -kEps) {
-        nextLoc = loc.Down();
-      } else if (fx <= -kEps) {
-        nextLoc = loc.Left();
-      } else if (map_->IsHall(loc.Down()) && !map_->IsHall(loc.Left())) {
-        nextLoc = loc.Down();
-      } else if (!map_->IsHall(loc.Down()) && map_->IsHall(loc.Left())) {
-        nextLoc = loc.Left();
       }
     }
-    if (playerState_.location.x == nextLoc.x &&
-        playerState_.location.y == nextLoc.y) {
-      playerState_.speed = 0.0;
-      break;
+    return false;
+  }
+
+ private:
+  static GameMap::Location HallOf(const Game::Location& location) {
+    return {static_cast<int>(std::round(location.x)),
+            static_cast<int>(std::round(location.y))};
+  }
+
+  // The endless map has negative coordinates too.
+  static uint64_t HallKey(GameMap::Location hall) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(hall.x)) << 32 |
+           static_cast<uint32_t>(hall.y);
+  }
+
+  std::span<const Game::PlayerState> playerStates_;
+  std::unordered_map<uint64_t, int> heads_;
+  std::vector<int> next_;
+};
+
+}  // namespace
+
+Game::Game(std::shared_ptr<const GameMap> map, int players)
+    : map_(std::move(map)) {
+  if (players <= 0) {
+    throw std::runtime_error("a game needs a player");
+  }
+  PlayerState playerState;
+  playerState.location = map_->GetEntranceLocation();
+  playerStates_.assign(players, NormalizePlayerState(playerState, *map_));
+}
+
+Game::Game(std::shared_ptr<const ChunkedMap> world, int players)
+    : world_(std::move(world)) {
+  if (players <= 0) {
+    throw std::runtime_error("a game needs a player");
+  }
+  PlayerState playerState;
+  playerState.location = world_->GetEntranceLocation();
+  playerStates_.assign(players, NormalizePlayerState(playerState, *world_));
+}
+
+void Game::ApplyPlayerActions(int player, PlayerActions actions,
+                              double seconds) {
+  ApplyPlayerActions(std::span(&actions, 1), seconds, player);
+}
+
+void Game::ApplyPlayerActions(std::span<const PlayerActions> actions,
+                              double seconds) {
+  if (actions.size() != playerStates_.size()) {
+    throw std::runtime_error("expected the actions of every player");
+  }
+  ApplyPlayerActions(actions, seconds, 0);
+}
+
+void Game::ApplyPlayerActions(std::span<const PlayerActions> actions,
+                              double seconds, int firstPlayer) {
+  const auto movePlayers = [&](const auto& map) {
+    for (size_t i = 0; i < actions.size(); ++i) {
+      auto& playerState = playerStates_[firstPlayer + i];
+      playerState = MovePlayer(playerState, map, actions[i], seconds);
+    }
+  };
+  if (world_) {
+    // The players are usually close to each other, so they share the chunk
+    // the view keeps.
+    movePlayers(ChunkedMap::View(*world_));
+  } else {
+    movePlayers(*map_);
+  }
+}
+
+bool Game::IsSolved() const {
+  const auto touchedExit = std::count_if(
+      playerStates_.begin(), playerStates_.end(),
+      [](const PlayerState& playerState) { return playerState.touchedExit; });
+  if (touchedExit == 0) {
+    return false;
+  }
+  if (touchedExit == GetPlayers()) {
+    return true;
+  }
+  const PlayerGrid grid(playerStates_);
+  for (int i = 0; i < GetPlayers(); ++i) {
+    if (playerStates_[i].touchedExit && grid.HasCompany(i)) {
+      return true;
     }
-    goTo(nextLoc);
   }
-  playerState_ = NormalizePlayerState(playerState_, *map_);
+  return false;
 }
 
 }  // namespace u7::game
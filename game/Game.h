@@ -4,10 +4,13 @@
 #ifndef U7_GAME_GAME_H_
 #define U7_GAME_GAME_H_
 
+#include "game/ChunkedMap.h"
 #include "game/GameMap.h"
 
 #include <bitset>
 #include <memory>
+#include <span>
+#include <vector>
 
 namespace u7::game {
 
@@ -42,17 +45,47 @@ class Game {
     bool ask2 = false;
   };
 
-  explicit Game(std::shared_ptr<const GameMap> map);
+  // The players start at the entrance.
+  explicit Game(std::shared_ptr<const GameMap> map, int players = 1);
 
+  // A game on an endless map.
+  explicit Game(std::shared_ptr<const ChunkedMap> world, int players = 1);
+
+  // The map must not be endless.
   [[nodiscard]] const GameMap& GetGameMap() const { return *map_; }
 
-  [[nodiscard]] PlayerState GetPlayerState() const { return playerState_; }
+  [[nodiscard]] int GetPlayers() const {
+    return static_cast<int>(playerStates_.size());
+  }
+
+  [[nodiscard]] PlayerState GetPlayerState(int player = 0) const {
+    return playerStates_[player];
+  }
+
+  // Moves a single player.
+  void ApplyPlayerActions(int player, PlayerActions actions, double seconds);
 
-  void ApplyPlayerActions(PlayerActions actions, double seconds);
+  // Moves every player; expects the actions of every player.
+  void ApplyPlayerActions(std::span<const PlayerActions> actions,
+                          double seconds);
+
+  // Returns whether every player has touched the exit, or a player who has
+  // touched the exit is back with another player.
+  //
+  // The players are put into a hash of the halls they are at, so only the
+  // players at the neighbouring halls are compared: the check is linear in
+  // the number of players.
+  [[nodiscard]] bool IsSolved() const;
 
  private:
+  // Moves the players from the given one on.
+  void ApplyPlayerActions(std::span<const PlayerActions> actions,
+                          double seconds, int firstPlayer);
+
+  // Exactly one of them is set.
   std::shared_ptr<const GameMap> map_;
-  PlayerState playerState_;
+  std::shared_ptr<const ChunkedMap> world_;
+  std::vector<PlayerState> playerStates_;
 };
 
 }  // namespace u7::game
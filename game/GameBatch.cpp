@@ -0,0 +1,90 @@
+#include "game/GameBatch.h"
+
+#include "algorithm/ParallelFor.h"
+#include "game/Movement.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace u7::game {
+namespace {
+
+// The players stepped together; the arrays of a block stay in the cache
+// between the passes of the step.
+constexpr size_t kBlockSize = 1024;
+
+}  // namespace
+
+GameBatch::GameBatch(std::shared_ptr<const GameMap> map, size_t players)
+    : map_(std::move(map)),
+      x_(players),
+      y_(players),
+      speed_(players),
+      flags_(players),
+      reach_(players) {
+  Reset();
+}
+
+Game::PlayerState GameBatch::GetPlayerState(size_t player) const {
+  Game::PlayerState result;
+  result.location.x = x_[player];
+  result.location.y = y_[player];
+  result.speed = speed_[player];
+  result.touchedExit = (flags_[player] & kTouchedExit) != 0;
+  result.ask1 = (flags_[player] & kAsk1) != 0;
+  result.ask2 = (flags_[player] & kAsk2) != 0;
+  return result;
+}
+
+void GameBatch::Reset() {
+  const GameMap::Location entrance = map_->GetEntranceLocation();
+  double x = entrance.x;
+  double y = entrance.y;
+  const bool touchedExit = movement::NormalizeLocation(*map_, x, y);
+  std::fill(x_.begin(), x_.end(), x);
+  std::fill(y_.begin(), y_.end(), y);
+  std::fill(speed_.begin(), speed_.end(), 0.0);
+  std::fill(flags_.begin(), flags_.end(), touchedExit ? kTouchedExit : 0);
+}
+
+void GameBatch::Step(std::span<const uint8_t> actions, double seconds,
+                     int threads) {
+  if (actions.size() != size()) {
+    throw std::runtime_error("expected the actions of every player");
+  }
+  const size_t blocks = (size() + kBlockSize - 1) / kBlockSize;
+  algorithm::ParallelFor(blocks, threads, [&](size_t block) {
+    StepBlock(block * kBlockSize, std::min(size(), (block + 1) * kBlockSize),
+              actions, seconds);
+  });
+}
+
+void GameBatch::StepBlock(size_t begin, size_t end,
+                          std::span<const uint8_t> actions, double seconds) {
+  const auto ask1Bit = static_cast<uint8_t>(Game::kPlayerAsk1.to_ulong());
+  const auto ask2Bit = static_cast<uint8_t>(Game::kPlayerAsk2.to_ulong());
+  const auto goMask = static_cast<uint8_t>(Game::kPlayerGoMask.to_ulong());
+  // The branch-free passes.
+  for (size_t i = begin; i < end; ++i) {
+    reach_[i] = movement::Accelerate(speed_[i], seconds);
+  }
+  for (size_t i = begin; i < end; ++i) {
+    flags_[i] = (flags_[i] & kTouchedExit) |
+                ((actions[i] & ask1Bit) != 0 ? kAsk1 : 0) |
+                ((actions[i] & ask2Bit) != 0 ? kAsk2 : 0);
+  }
+  // The walks through the map.
+  const GameMap& map = *map_;
+  for (size_t i = begin; i < end; ++i) {
+    if (!movement::MoveAlong(map, Game::PlayerActions(actions[i] & goMask),
+                             x_[i], y_[i], reach_[i])) {
+      speed_[i] = 0.0;
+    }
+    if (movement::NormalizeLocation(map, x_[i], y_[i])) {
+      flags_[i] |= kTouchedExit;
+    }
+  }
+}
+
+}  // namespace u7::game
@@ -0,0 +1,67 @@
+#ifndef U7_GAME_GAME_BATCH_H_
+#define U7_GAME_GAME_BATCH_H_
+
+#include "game/Game.h"
+#include "game/GameMap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace u7::game {
+
+// Many independent players on one map, with the same movement as Game,
+// stepped by several threads at once. The state of the players is kept in
+// separate arrays; the actions are bytes with the bits of
+// Game::PlayerActions.
+class GameBatch {
+ public:
+  // The bits of GetFlags().
+  static constexpr uint8_t kTouchedExit = 1;
+  static constexpr uint8_t kAsk1 = 2;
+  static constexpr uint8_t kAsk2 = 4;
+
+  GameBatch(std::shared_ptr<const GameMap> map, size_t players);
+
+  [[nodiscard]] const GameMap& GetGameMap() const { return *map_; }
+
+  [[nodiscard]] size_t size() const { return x_.size(); }
+
+  [[nodiscard]] std::span<const double> GetX() const { return x_; }
+
+  [[nodiscard]] std::span<const double> GetY() const { return y_; }
+
+  [[nodiscard]] std::span<const double> GetSpeed() const { return speed_; }
+
+  [[nodiscard]] std::span<const uint8_t> GetFlags() const { return flags_; }
+
+  [[nodiscard]] Game::PlayerState GetPlayerState(size_t player) const;
+
+  // Puts every player to the entrance.
+  void Reset();
+
+  // Same as Game::ApplyPlayerActions() for every player; the players are
+  // split between the threads by blocks, and a non-positive number means
+  // one thread per core.
+  void Step(std::span<const uint8_t> actions, double seconds,
+            int threads = 1);
+
+ private:
+  void StepBlock(size_t begin, size_t end, std::span<const uint8_t> actions,
+                 double seconds);
+
+  std::shared_ptr<const GameMap> map_;
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> speed_;
+  std::vector<uint8_t> flags_;
+
+  // The distance every player covers during the step.
+  std::vector<double> reach_;
+};
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_GAME_BATCH_H_
@@ -4,13 +4,42 @@
 #ifndef U7_GAME_GAMEMAP_H_
 #define U7_GAME_GAMEMAP_H_
 
-#include "algorithm/Matrix.h"
+#include "algorithm/PackedArray.h"
 #include "maze/Maze.h"
 
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace u7::game {
 
+class JunctionGraph;
+
+struct GameMapOptions {
+  // Build the direction to the exit for every hall, 2 bits per hall; makes
+  // GetNextStepToExit() and GetPathToExit() cheaper.
+  bool directionsToExit = false;
+
+  // Build the graph of the junctions and the corridors; see
+  // GetJunctionGraph().
+  bool junctionGraph = false;
+
+  // The number of threads of the exit distance search and of the directions
+  // to the exit; non-positive means one thread per core. The results do not
+  // depend on it.
+  int threads = 1;
+
+  // Build the runs of every hall, 8 bytes per hall; see GetHallRun() and
+  // GetCorridorRun().
+  bool runs = false;
+
+  bool operator==(const GameMapOptions& rhs) const = default;
+};
+
 class GameMap {
  public:
   struct Location {
@@ -27,9 +56,68 @@ class GameMap {
     }
   };
 
+  enum class Direction : uint8_t { kUp, kDown, kLeft, kRight };
+
+  // The locations of a shortest path to the exit: from the start to the
+  // exit, both inclusive; empty if there is no path.
+  class Path {
+   public:
+    class Iterator {
+     public:
+      using difference_type = std::ptrdiff_t;
+      using value_type = Location;
+
+      Iterator() = default;
+
+      Location operator*() const { return loc_; }
+
+      Iterator& operator++() {
+        if (loc_ == map_->exit_) {
+          map_ = nullptr;
+        } else {
+          loc_ = map_->GetNextStepToExit(loc_);
+        }
+        return *this;
+      }
+
+      Iterator operator++(int) {
+        Iterator result = *this;
+        ++*this;
+        return result;
+      }
+
+      bool operator==(std::default_sentinel_t) const {
+        return map_ == nullptr;
+      }
+
+     private:
+      friend class Path;
+
+      Iterator(const GameMap* map, Location loc) : map_(map), loc_(loc) {}
+
+      const GameMap* map_ = nullptr;
+      Location loc_;
+    };
+
+    [[nodiscard]] Iterator begin() const { return Iterator(map_, start_); }
+
+    [[nodiscard]] std::default_sentinel_t end() const { return {}; }
+
+   private:
+    friend class GameMap;
+
+    Path(const GameMap* map, Location start) : map_(map), start_(start) {}
+
+    const GameMap* map_;
+    Location start_;
+  };
+
   GameMap() = default;
+  GameMap(const GameMap&) = delete;
+  GameMap& operator=(const GameMap&) = delete;
 
-  GameMap(maze::Maze maze, Location entrance, Location exit);
+  GameMap(maze::Maze maze, Location entrance, Location exit,
+          GameMapOptions options = {});
 
   [[nodiscard]] int GetWidth() const { return maze_.m(); }
 
@@ -47,30 +135,307 @@ class GameMap {
     return !Contains(loc) || !maze_.UnsafeAt(loc.y, loc.x);
   }
 
+  // Same as IsHall(), but the location must be within one cell of the map;
+  // the map is surrounded by a border of walls, so no bounds check is needed.
+  [[nodiscard]] bool UnsafeIsHall(Location loc) const {
+    return maze_.UnsafeAt(loc.y, loc.x);
+  }
+
   [[nodiscard]] Location GetEntranceLocation() const { return entrance_; }
 
   [[nodiscard]] Location GetExitLocation() const { return exit_; }
 
+  // Returns the length of the shortest path to the exit, or size_t(-1) if
+  // the location is a wall or there is no path.
   [[nodiscard]] size_t GetDistanceToExit(Location loc) const {
-    return (Contains(loc) ? distanceToExit_.UnsafeAt(loc.y, loc.x)
-                          : static_cast<size_t>(-1));
+    return (IsHall(loc) ? LoadDistance(loc) : static_cast<size_t>(-1));
   }
 
   [[nodiscard]] size_t MaxDistanceToExit() const { return maxDistanceToExit_; }
 
+  // Turns the wall into a hall and repairs the distances to the exit; the
+  // cost is proportional to the number of the halls whose distance changes.
+  // Drops the directions to the exit, the junction graph, and the runs; a
+  // JunctionGraph or a DistanceOracle of the changed halls has to be built
+  // on a new GameMap.
+  void OpenCell(Location loc);
+
+  // Turns the hall into a wall and repairs the distances to the exit; the
+  // cost is proportional to the number of the halls whose shortest paths
+  // all went through the cell. The exit cannot be closed. Drops the
+  // directions to the exit, the junction graph, and the runs; a
+  // JunctionGraph or a DistanceOracle of the changed halls has to be built
+  // on a new GameMap.
+  void CloseCell(Location loc);
+
+  // The number of the cells OpenCell() and CloseCell() have changed, which
+  // tells whether the map is still the one an index was built on.
+  [[nodiscard]] uint64_t GetChangeCount() const { return changeCount_; }
+
+  // The halls of the map as it was constructed; OpenCell() and CloseCell()
+  // do not change them.
+  [[nodiscard]] size_t GetHallCount() const {
+    return (hallRank_.empty() ? 0 : hallRank_.back());
+  }
+
+  // Returns the index of the hall among all the halls of the map as it was
+  // constructed, in [0, GetHallCount()), in the row-major order; the
+  // location must be such a hall.
+  [[nodiscard]] size_t GetHallIndex(Location loc) const {
+    return HallIndex(loc.y, loc.x);
+  }
+
+  // Returns the graph of the junctions and the corridors, or nullptr if it
+  // was not requested.
+  [[nodiscard]] const std::shared_ptr<const JunctionGraph>& GetJunctionGraph()
+      const {
+    return junctionGraph_;
+  }
+
+  static constexpr int kMaxRun = UINT8_MAX;
+
+  [[nodiscard]] bool HasRuns() const { return !runs_.empty(); }
+
+  // Returns the number of steps from the hall in the direction that stay on
+  // the halls, i.e. the distance to the wall minus one. Capped at kMaxRun;
+  // 0 if the runs were not requested or were dropped.
+  [[nodiscard]] int GetHallRun(Location loc, Direction direction) const {
+    return LoadRun(loc, static_cast<size_t>(direction));
+  }
+
+  // Same as GetHallRun(), but the halls on the way, except the last one,
+  // must be straight corridor halls, with walls on both sides across the
+  // direction. So the last step lands on a junction, a turn, a dead end, or
+  // the last hall before a wall.
+  [[nodiscard]] int GetCorridorRun(Location loc, Direction direction) const {
+    return LoadRun(loc, 4 + static_cast<size_t>(direction));
+  }
+
+  [[nodiscard]] bool HasDirectionsToExit() const {
+    return !directionToExit_.empty();
+  }
+
+  // Returns the neighbour of the location that is one step closer to the
+  // exit; the location must have a path to the exit and must not be the
+  // exit itself.
+  [[nodiscard]] Location GetNextStepToExit(Location loc) const;
+
+  // Walks a shortest path to the exit in O(path length).
+  [[nodiscard]] Path GetPathToExit(Location loc) const {
+    return Path(
+        (GetDistanceToExit(loc) == static_cast<size_t>(-1) ? nullptr : this),
+        loc);
+  }
+
  private:
-  void InitDistanceToExit();
+  void InitHallRank();
+
+  void InitDistanceToExit(bool directions, int threads);
+
+  void InitRuns();
+
+  // Prepares the map for OpenCell() and CloseCell().
+  void InitMutable();
+
+  // Returns the index of the hall (i, j) among all the indexed halls in the
+  // row-major order.
+  [[nodiscard]] size_t HallIndex(int i, int j) const {
+    const maze::Maze& halls = *indexedHalls_;
+    const int b = halls.BitIndex(j);
+    const int k = b / maze::Maze::kWordBits;
+    const maze::Maze::Word below =
+        (maze::Maze::Word{1} << (b % maze::Maze::kWordBits)) - 1;
+    return hallRank_[static_cast<size_t>(i) * halls.WordsPerRow() + k] +
+           std::popcount(halls.Row(i)[k] & below);
+  }
+
+  [[nodiscard]] int LoadRun(Location loc, size_t run) const {
+    return (runs_.empty() ? 0 : runs_[HallIndex(loc.y, loc.x) * 8 + run]);
+  }
+
+  // Returns the distance of the hall, or size_t(-1).
+  [[nodiscard]] size_t LoadDistance(Location loc) const {
+    if (!indexedHalls_->UnsafeAt(loc.y, loc.x)) {
+      return openedDistance_.at(CellKey(loc));
+    }
+    const uint64_t distance = distanceToExit_.Get(HallIndex(loc.y, loc.x));
+    return (distance == distanceToExit_.MaxValue() ? static_cast<size_t>(-1)
+                                                   : distance);
+  }
+
+  // Sets the distance of the hall and keeps the histogram up to date.
+  void StoreDistance(Location loc, size_t distance);
+
+  [[nodiscard]] uint64_t CellKey(Location loc) const {
+    return static_cast<uint64_t>(loc.y) * maze_.m() + loc.x;
+  }
 
   maze::Maze maze_;
   Location entrance_;
   Location exit_;
 
-  algorithm::Matrix<size_t> distanceToExit_;
+  // The number of halls before every word of the rows.
+  std::vector<uint64_t> hallRank_;
+
+  // The distances of the halls, indexed by HallIndex(), at the narrowest
+  // width that fits; the largest value of the width marks the unreachable
+  // halls.
+  algorithm::PackedArray distanceToExit_;
+
+  // The Direction of the next step to the exit for every hall, indexed by
+  // HallIndex(), 32 halls per word; empty unless requested.
+  std::vector<uint64_t> directionToExit_;
+
+  std::shared_ptr<const JunctionGraph> junctionGraph_;
+
+  // The GetHallRun() and then the GetCorridorRun() of every hall in every
+  // Direction, 8 bytes per hall indexed by HallIndex(); empty unless
+  // requested.
+  std::vector<uint8_t> runs_;
+
+  // The halls indexed by HallIndex(): the halls of the map as it was
+  // constructed. That is maze_ itself until the first OpenCell() or
+  // CloseCell(), which makes a copy, so the index never checks whether the
+  // map was changed; the map cannot be copied for the same reason.
+  const maze::Maze* indexedHalls_ = &maze_;
+
+  // Set up by the first OpenCell() or CloseCell(): the copy of the halls of
+  // the constructed map, the distances of the halls opened later, and the
+  // number of the halls at every distance.
+  maze::Maze frozenHalls_;
+  std::unordered_map<uint64_t, size_t> openedDistance_;
+  std::vector<size_t> distanceHistogram_;
   size_t maxDistanceToExit_ = 0;
+  uint64_t changeCount_ = 0;
 };
 
+// Places the entrance and the exit into the opposite corners of the maze.
+std::shared_ptr<GameMap> MakeGameMap(maze::Maze maze,
+                                     GameMapOptions options = {});
+
 std::shared_ptr<GameMap> GenGameMap(int width, int height, maze::Rng rng,
-                                    maze::GenMazeOptions options = {});
+                                    maze::GenMazeOptions options = {},
+                                    GameMapOptions mapOptions = {});
+
+// Same as GenGameMap() above, but with the compile-time maze options.
+template <maze::GenMazeOptions kOptions, typename RngT>
+std::shared_ptr<GameMap> GenGameMap(int width, int height, RngT&& rng,
+                                    GameMapOptions mapOptions = {}) {
+  return MakeGameMap(maze::GenMaze<kOptions>(height, width, rng), mapOptions);
+}
+
+// The metrics of how hard a map is to solve.
+struct MapDifficulty {
+  // The length of the shortest path from the entrance to the exit.
+  size_t pathLength = 0;
+
+  // The same as GameMap::MaxDistanceToExit().
+  size_t maxDistanceToExit = 0;
+
+  // The share of the halls with exactly one neighbouring hall.
+  double deadEndRatio = 0.0;
+
+  // The mean of three terms in [0, 1]: how much the path winds,
+  // 1 - manhattan(entrance, exit) / pathLength; how far the entrance is
+  // compared to the farthest hall, pathLength / maxDistanceToExit; and
+  // min(1, deadEndRatio / kDeadEndRatioScale).
+  //
+  // The terms depend mostly on the size and the options of the maze, and
+  // little on the seed: the maps of one size and options score within a few
+  // hundredths of each other, so the raw score ranks such maps but does not
+  // tell how hard a map is among them; see DifficultyCalibration.
+  double rawScore = 0.0;
+
+  // A typical dead end ratio of the mazes with many dead ends.
+  static constexpr double kDeadEndRatioScale = 0.25;
+};
+
+[[nodiscard]] MapDifficulty GetMapDifficulty(const GameMap& map);
+
+// The raw scores of a sample of the maps of one size and options, which
+// turn the raw score of a map into its rank among such maps.
+//
+// The sample takes as long to generate as `samples` maps, 64 by default, so
+// a calibration should be built once for a size and options and kept for
+// all the maps of them; only then does GenGameMapForDifficulty() take about
+// the time of one map on a machine with `candidates` cores.
+class DifficultyCalibration {
+ public:
+  // Generates `samples` maps, several at a time, each with its own seed
+  // derived from the given one.
+  DifficultyCalibration(int width, int height, uint64_t seed,
+                        maze::GenMazeOptions options = {},
+                        GameMapOptions mapOptions = {}, int samples = 64,
+                        int threads = 0);
+
+  [[nodiscard]] int GetWidth() const { return width_; }
+
+  [[nodiscard]] int GetHeight() const { return height_; }
+
+  [[nodiscard]] const maze::GenMazeOptions& GetOptions() const {
+    return options_;
+  }
+
+  [[nodiscard]] const GameMapOptions& GetMapOptions() const {
+    return mapOptions_;
+  }
+
+  // Returns the share of the sample maps with a lower raw score, counting
+  // the equal ones as half, in [0, 1]: 0 is at most as hard as the easiest
+  // sample map, 0.5 is the median, and 1 is at least as hard as the hardest
+  // one.
+  [[nodiscard]] double GetScore(const MapDifficulty& difficulty) const;
+
+ private:
+  int width_;
+  int height_;
+  maze::GenMazeOptions options_;
+  GameMapOptions mapOptions_;
+
+  // Sorted.
+  std::vector<double> rawScores_;
+};
+
+struct DifficultyOptions {
+  // The wanted DifficultyCalibration::GetScore(): the share of the maps of
+  // the size and the options of the calibration that are easier than the
+  // result; 0.9 asks for a map harder than nine maps in ten.
+  double target = 0.5;
+
+  // The search takes the first candidate whose score is this close to the
+  // target.
+  double tolerance = 0.05;
+
+  // The maximum number of candidate maps.
+  int candidates = 8;
+
+  // The number of threads; non-positive means one thread per core.
+  int threads = 0;
+};
+
+struct DifficultyMap {
+  std::shared_ptr<GameMap> map;
+
+  // The seed of the maze: GenGameMap() with algorithm::Philox4x32(seed) and
+  // the options of the calibration generates the same map, so it can be
+  // replayed.
+  uint64_t seed = 0;
+
+  // DifficultyCalibration::GetScore() of the map.
+  double score = 0.0;
+};
+
+// Generates up to `candidates` maps of the size and the options of the
+// calibration, several at a time, and returns the first one, in the order of
+// the candidates, whose score is within the tolerance of the target, or the
+// one with the score nearest to the target if there is none. The candidates
+// past the first one within the tolerance are not generated, unless they
+// were started before it was found. Every candidate has its own seed derived
+// from the given one, which should differ from the seed of the calibration;
+// the result depends only on the seeds, not on the threads.
+DifficultyMap GenGameMapForDifficulty(const DifficultyCalibration& calibration,
+                                      uint64_t seed,
+                                      DifficultyOptions difficultyOptions = {});
 
 }  // namespace u7::game
 
@@ -0,0 +1,212 @@
+#include "game/JunctionGraph.h"
+
+#include <stdexcept>
+
+namespace u7::game {
+namespace {
+
+using Direction = GameMap::Direction;
+
+constexpr Direction kDirections[] = {Direction::kUp, Direction::kDown,
+                                     Direction::kLeft, Direction::kRight};
+
+int Degree(const GameMap& map, GameMap::Location loc) {
+  return map.UnsafeIsHall(loc.Up()) + map.UnsafeIsHall(loc.Down()) +
+         map.UnsafeIsHall(loc.Left()) + map.UnsafeIsHall(loc.Right());
+}
+
+}  // namespace
+
+template <typename Fn>
+JunctionGraph::WalkEnd JunctionGraph::Walk(const GameMap& map, Location loc,
+                                           Direction direction,
+                                           Fn&& fn) const {
+  for (uint32_t steps = 1;; ++steps) {
+    loc = Step(loc, direction);
+    const size_t h = map.GetHallIndex(loc);
+    if (IsNodeHall(h)) {
+      return WalkEnd{h, steps, Opposite(direction)};
+    }
+    fn(h);
+    direction = NextStep(map, loc, direction);
+  }
+}
+
+JunctionGraph::JunctionGraph(const GameMap& map) {
+  if (map.GetChangeCount() != 0) {
+    throw std::runtime_error("the junction graph needs an unchanged map");
+  }
+  const size_t hallCount = map.GetHallCount();
+  if (hallCount >= kNone) {
+    throw std::runtime_error("too many halls for the junction graph");
+  }
+  nodeBits_.assign((hallCount + 63) / 64, 0);
+  // The halls are indexed in the row-major order.
+  const auto forEachHall = [&](auto&& fn) {
+    size_t h = 0;
+    for (int y = 0; y < map.GetHeight(); ++y) {
+      for (int x = 0; x < map.GetWidth(); ++x) {
+        const Location loc{x, y};
+        if (map.UnsafeIsHall(loc)) {
+          fn(loc, h++);
+        }
+      }
+    }
+  };
+  forEachHall([&](Location loc, size_t h) {
+    if (Degree(map, loc) != 2) {
+      nodeBits_[h / 64] |= uint64_t{1} << (h % 64);
+    }
+  });
+  // The ends of the edges are kept as the halls until the nodes are
+  // numbered; the order of the halls is the order of the nodes. The corridor
+  // halls walked are marked, so that the loops with no node are found.
+  std::vector<uint64_t> walked(nodeBits_.size(), 0);
+  const auto isWalked = [&](size_t hall) {
+    return (walked[hall / 64] >> (hall % 64) & 1) != 0;
+  };
+  const auto addEdges = [&](Location loc, size_t h) {
+    for (const Direction direction : kDirections) {
+      const Location first = Step(loc, direction);
+      if (!map.UnsafeIsHall(first) || isWalked(map.GetHallIndex(first))) {
+        continue;  // A wall, or an edge walked from the other end.
+      }
+      const WalkEnd end = Walk(map, loc, direction, [&](size_t hall) {
+        walked[hall / 64] |= uint64_t{1} << (hall % 64);
+      });
+      // The edges between two neighbouring nodes have no halls to mark, and
+      // are seen from both ends.
+      if (h < end.hall || (h == end.hall && direction < end.back)) {
+        edges_.push_back(Edge{static_cast<uint32_t>(h),
+                              static_cast<uint32_t>(end.hall), end.steps,
+                              direction, end.back});
+      }
+    }
+  };
+  forEachHall([&](Location loc, size_t h) {
+    if (IsNodeHall(h)) {
+      addEdges(loc, h);
+    }
+  });
+  // The halls left are on the loops with no node; one hall of every such
+  // loop becomes a node.
+  forEachHall([&](Location loc, size_t h) {
+    if (!IsNodeHall(h) && !isWalked(h)) {
+      nodeBits_[h / 64] |= uint64_t{1} << (h % 64);
+      addEdges(loc, h);
+    }
+  });
+  nodeRank_.resize(nodeBits_.size());
+  uint32_t rank = 0;
+  for (size_t k = 0; k < nodeBits_.size(); ++k) {
+    nodeRank_[k] = rank;
+    rank += std::popcount(nodeBits_[k]);
+  }
+  nodes_.reserve(rank);
+  forEachHall([&](Location loc, size_t h) {
+    if (IsNodeHall(h)) {
+      nodes_.push_back(loc);
+    }
+  });
+  for (Edge& edge : edges_) {
+    edge.from = GetNode(edge.from);
+    edge.to = GetNode(edge.to);
+  }
+  edges_.shrink_to_fit();
+  // The arcs of a node are contiguous.
+  arcBegin_.assign(nodes_.size() + 1, 0);
+  for (const Edge& edge : edges_) {
+    ++arcBegin_[edge.from + 1];
+    ++arcBegin_[edge.to + 1];
+  }
+  for (size_t node = 0; node < nodes_.size(); ++node) {
+    arcBegin_[node + 1] += arcBegin_[node];
+  }
+  arcs_.resize(2 * edges_.size());
+  std::vector<uint32_t> arcEnd(arcBegin_.begin(), arcBegin_.end() - 1);
+  for (uint32_t e = 0; e < edges_.size(); ++e) {
+    const Edge& edge = edges_[e];
+    arcs_[arcEnd[edge.from]++] = Arc{e, edge.to, edge.length};
+    arcs_[arcEnd[edge.to]++] = Arc{e, edge.from, edge.length};
+  }
+}
+
+JunctionGraph::Position JunctionGraph::GetPosition(const GameMap& map,
+                                                   Location loc) const {
+  if (const uint32_t node = GetNode(map.GetHallIndex(loc)); node != kNone) {
+    return Position{.node = node};
+  }
+  // One end of the corridor and the first step from it back into the
+  // corridor tell the edge.
+  Direction direction = Direction::kUp;
+  for (const Direction d : kDirections) {
+    if (map.UnsafeIsHall(Step(loc, d))) {
+      direction = d;
+      break;
+    }
+  }
+  const WalkEnd end = Walk(map, loc, direction, [](size_t) {});
+  const uint32_t node = GetNode(end.hall);
+  for (const Arc& arc : GetArcs(node)) {
+    const Edge& edge = edges_[arc.edge];
+    if (edge.from == node && edge.fromDirection == end.back) {
+      return Position{.edge = arc.edge, .offset = end.steps};
+    }
+    if (edge.to == node && edge.toDirection == end.back) {
+      return Position{.edge = arc.edge, .offset = edge.length - end.steps};
+    }
+  }
+  throw std::runtime_error("the map does not match the junction graph");
+}
+
+std::vector<JunctionGraph::Location> JunctionGraph::GetEdgeHalls(
+    const GameMap& map, uint32_t edge) const {
+  std::vector<Location> result;
+  result.reserve(edges_[edge].length - 1);
+  ForEachEdgeHall(map, edge,
+                  [&](Location loc, uint32_t) { result.push_back(loc); });
+  return result;
+}
+
+size_t JunctionGraph::MemoryUsage() const {
+  return nodes_.capacity() * sizeof(Location) +
+         edges_.capacity() * sizeof(Edge) +
+         arcBegin_.capacity() * sizeof(uint32_t) +
+         arcs_.capacity() * sizeof(Arc) +
+         nodeBits_.capacity() * sizeof(uint64_t) +
+         nodeRank_.capacity() * sizeof(uint32_t);
+}
+
+JunctionGraph::Location JunctionGraph::Step(Location loc,
+                                            Direction direction) {
+  switch (direction) {
+    case Direction::kUp:
+      return loc.Up();
+    case Direction::kDown:
+      return loc.Down();
+    case Direction::kLeft:
+      return loc.Left();
+    case Direction::kRight:
+      return loc.Right();
+  }
+  return loc;
+}
+
+JunctionGraph::Direction JunctionGraph::Opposite(Direction direction) {
+  // The opposite directions are the pairs of Direction.
+  return static_cast<Direction>(static_cast<uint8_t>(direction) ^ 1);
+}
+
+JunctionGraph::Direction JunctionGraph::NextStep(const GameMap& map,
+                                                 Location loc,
+                                                 Direction direction) {
+  const Direction back = Opposite(direction);
+  for (const Direction d : kDirections) {
+    if (d != back && map.UnsafeIsHall(Step(loc, d))) {
+      return d;
+    }
+  }
+  return back;
+}
+
+}  // namespace u7::game
@@ -0,0 +1,158 @@
+#ifndef U7_GAME_JUNCTION_GRAPH_H_
+#define U7_GAME_JUNCTION_GRAPH_H_
+
+#include "game/GameMap.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace u7::game {
+
+// The halls of a map with the corridors contracted.
+//
+// The nodes are the halls that do not have exactly two neighbouring halls:
+// the junctions and the dead ends. An edge is a corridor between two nodes,
+// and its length is the number of steps from one end to the other. A loop
+// of corridor halls with no node on it gets one of its halls as a node, so
+// every hall is either a node or a hall of exactly one edge.
+//
+// The nodes are numbered in the order of GameMap::GetHallIndex(), and the
+// graph keeps one bit per hall to tell the nodes; the corridor halls are
+// found by walking the corridors, so the graph takes memory in proportion
+// to the nodes and the edges rather than the halls.
+class JunctionGraph {
+ public:
+  using Direction = GameMap::Direction;
+  using Location = GameMap::Location;
+
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Edge {
+    uint32_t from = kNone;
+    uint32_t to = kNone;
+    uint32_t length = 0;
+    // The first steps from `from` and from `to` into the edge.
+    Direction fromDirection = Direction::kUp;
+    Direction toDirection = Direction::kUp;
+  };
+
+  // An edge as seen from one of its nodes.
+  struct Arc {
+    uint32_t edge = kNone;
+    uint32_t node = kNone;  // The other end.
+    uint32_t length = 0;
+  };
+
+  // A hall is either the node, or the hall of the edge that is `offset`
+  // steps away from the edge's `from` node, with 0 < offset < length.
+  struct Position {
+    uint32_t node = kNone;
+    uint32_t edge = kNone;
+    uint32_t offset = 0;
+  };
+
+  // The map must not have been changed by GameMap::OpenCell() or
+  // CloseCell(), nor be changed while the graph is used.
+  explicit JunctionGraph(const GameMap& map);
+
+  [[nodiscard]] size_t GetNodeCount() const { return nodes_.size(); }
+
+  [[nodiscard]] size_t GetEdgeCount() const { return edges_.size(); }
+
+  [[nodiscard]] Location GetNodeLocation(uint32_t node) const {
+    return nodes_[node];
+  }
+
+  [[nodiscard]] const Edge& GetEdge(uint32_t edge) const {
+    return edges_[edge];
+  }
+
+  [[nodiscard]] std::span<const Arc> GetArcs(uint32_t node) const {
+    return std::span<const Arc>(arcs_).subspan(
+        arcBegin_[node], arcBegin_[node + 1] - arcBegin_[node]);
+  }
+
+  // Returns the node of the hall given by GameMap::GetHallIndex(), or kNone
+  // if the hall is a corridor hall.
+  [[nodiscard]] uint32_t GetNode(size_t hall) const {
+    const uint64_t word = nodeBits_[hall / 64];
+    const uint64_t bit = uint64_t{1} << (hall % 64);
+    if ((word & bit) == 0) {
+      return kNone;
+    }
+    return nodeRank_[hall / 64] + std::popcount(word & (bit - 1));
+  }
+
+  // Returns the position of the hall; the map must be the one the graph was
+  // built from. A corridor hall is found by walking the corridor to its
+  // ends, so the cost is the length of the corridor.
+  [[nodiscard]] Position GetPosition(const GameMap& map, Location loc) const;
+
+  // Returns the halls of the edge in the order from `from` to `to`, both
+  // exclusive; the map must be the one the graph was built from.
+  [[nodiscard]] std::vector<Location> GetEdgeHalls(const GameMap& map,
+                                                   uint32_t edge) const;
+
+  // Calls fn(loc, offset) for the halls of the edge in the order from
+  // `from` to `to`, both exclusive; the map must be the one the graph was
+  // built from.
+  template <typename Fn>
+  void ForEachEdgeHall(const GameMap& map, uint32_t edge, Fn&& fn) const {
+    const Edge& e = edges_[edge];
+    Location loc = nodes_[e.from];
+    Direction direction = e.fromDirection;
+    for (uint32_t offset = 1; offset < e.length; ++offset) {
+      loc = Step(loc, direction);
+      fn(loc, offset);
+      direction = NextStep(map, loc, direction);
+    }
+  }
+
+  // The memory taken by the graph.
+  [[nodiscard]] size_t MemoryUsage() const;
+
+ private:
+  // The end of a walk along a corridor.
+  struct WalkEnd {
+    size_t hall = 0;
+    uint32_t steps = 0;
+    // The first step from the end back into the corridor.
+    Direction back = Direction::kUp;
+  };
+
+  static Location Step(Location loc, Direction direction);
+
+  static Direction Opposite(Direction direction);
+
+  // Returns the direction out of the corridor hall other than the way back
+  // against `direction`.
+  static Direction NextStep(const GameMap& map, Location loc,
+                            Direction direction);
+
+  // Walks from the hall in the direction until a node, and calls
+  // fn(hall) for every corridor hall on the way.
+  template <typename Fn>
+  WalkEnd Walk(const GameMap& map, Location loc, Direction direction,
+               Fn&& fn) const;
+
+  [[nodiscard]] bool IsNodeHall(size_t hall) const {
+    return (nodeBits_[hall / 64] >> (hall % 64) & 1) != 0;
+  }
+
+  std::vector<Location> nodes_;
+  std::vector<Edge> edges_;
+  std::vector<uint32_t> arcBegin_;
+  std::vector<Arc> arcs_;
+
+  // A bit for every hall by its index, set for the nodes, and the number of
+  // the nodes before every word.
+  std::vector<uint64_t> nodeBits_;
+  std::vector<uint32_t> nodeRank_;
+};
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_JUNCTION_GRAPH_H_
@@ -0,0 +1,128 @@
+#include "game/MapPipeline.h"
+
+#include "algorithm/Hash.h"
+
+#include <cmath>
+#include <utility>
+
+namespace u7::game {
+
+using ::u7::palettes::Colour3f;
+
+MapMesh BuildMapMesh(const GameMap& map,
+                     std::span<const std::vector<Colour3f>> palettes) {
+  MapMesh result;
+  result.colours.resize(palettes.size());
+  const auto addVertex = [&](GameMap::Location loc) {
+    result.vertices.push_back(loc.x);
+    result.vertices.push_back(loc.y);
+    const float value = 1.0f - (0.0625f + map.GetDistanceToExit(loc)) /
+                                   (0.0625f + map.MaxDistanceToExit());
+    for (size_t p = 0; p < palettes.size(); ++p) {
+      const Colour3f colour = GetColour(value, palettes[p]);
+      result.colours[p].push_back(MapMesh::Colour3ub{
+          static_cast<uint8_t>(std::lround(colour.r * 255)),
+          static_cast<uint8_t>(std::lround(colour.g * 255)),
+          static_cast<uint8_t>(std::lround(colour.b * 255))});
+    }
+  };
+  for (int x = 0; x < map.GetWidth(); ++x) {
+    for (int y = 0; y < map.GetHeight(); ++y) {
+      const GameMap::Location loc{x, y};
+      if (!map.IsHall(loc)) {
+        continue;
+      }
+      for (auto newLoc : {loc.Right(), loc.Up()}) {
+        if (map.IsHall(newLoc)) {
+          addVertex(loc);
+          addVertex(newLoc);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+MapPipeline::MapPipeline(BuildFn build,
+                         std::vector<std::vector<Colour3f>> palettes,
+                         uint64_t seed)
+    : build_(std::move(build)), palettes_(std::move(palettes)), seed_(seed) {
+  thread_ = std::thread([this] { BuildLoop(); });
+}
+
+MapPipeline::~MapPipeline() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void MapPipeline::Prepare(const MapSpec& spec) {
+  {
+    std::lock_guard lock(mutex_);
+    if (wanted_ == spec) {
+      return;
+    }
+    Want(spec);
+  }
+  cv_.notify_all();
+}
+
+PreparedMap MapPipeline::Take(const MapSpec& spec) {
+  std::unique_lock lock(mutex_);
+  if (wanted_ != spec) {
+    Want(spec);
+    cv_.notify_all();
+  }
+  cv_.wait(lock, [&] { return ready_ || error_; });
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+  PreparedMap result = std::move(*ready_);
+  ready_.reset();
+  // The background thread starts on the next map.
+  cv_.notify_all();
+  return result;
+}
+
+void MapPipeline::Want(const MapSpec& spec) {
+  wanted_ = spec;
+  if (ready_ && readySpec_ != spec) {
+    ready_.reset();
+  }
+  error_ = nullptr;
+}
+
+void MapPipeline::BuildLoop() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [&] { return stop_ || (wanted_ && !ready_ && !error_); });
+    if (stop_) {
+      return;
+    }
+    const MapSpec spec = *wanted_;
+    const uint64_t seed = algorithm::DeriveSeed(seed_, builds_++);
+    lock.unlock();
+    std::optional<PreparedMap> result;
+    std::exception_ptr error;
+    try {
+      auto map = build_(spec.width, spec.height, spec.options, seed);
+      auto mesh = BuildMapMesh(*map, palettes_);
+      result = PreparedMap{std::move(map), std::move(mesh), seed};
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (wanted_ != spec) {
+      continue;
+    }
+    ready_ = std::move(result);
+    readySpec_ = spec;
+    error_ = error;
+    cv_.notify_all();
+  }
+}
+
+}  // namespace u7::game
@@ -0,0 +1,113 @@
+#ifndef U7_GAME_MAP_PIPELINE_H_
+#define U7_GAME_MAP_PIPELINE_H_
+
+#include "game/GameMap.h"
+#include "palettes/Palettes.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace u7::game {
+
+// The corridors of a map as GL_LINES: every pair of vertices joins two
+// neighbouring halls.
+struct MapMesh {
+  struct Colour3ub {
+    uint8_t r, g, b;
+  };
+
+  // The x, y pairs.
+  std::vector<int32_t> vertices;
+
+  // For every palette, the colour of every vertex by the distance to exit.
+  std::vector<std::vector<Colour3ub>> colours;
+};
+
+MapMesh BuildMapMesh(
+    const GameMap& map,
+    std::span<const std::vector<palettes::Colour3f>> palettes);
+
+// What a map is built for; a map built for another spec is never returned.
+struct MapSpec {
+  int width = 0;
+  int height = 0;
+  GameMapOptions options;
+
+  bool operator==(const MapSpec& rhs) const = default;
+};
+
+struct PreparedMap {
+  std::shared_ptr<const GameMap> map;
+  MapMesh mesh;
+
+  // The seed the map was built from.
+  uint64_t seed = 0;
+};
+
+// Builds the maps and their meshes on a background thread, so the next map
+// is usually ready by the time it is needed.
+//
+// The pipeline keeps at most one map ready. Once it is taken, the building
+// of the next one starts right away, for the same spec. A change of the spec
+// drops the ready map; a map that is being built for the old spec is
+// dropped when it is done.
+//
+// All the methods are thread-safe.
+class MapPipeline {
+ public:
+  using BuildFn = std::function<std::shared_ptr<const GameMap>(
+      int width, int height, GameMapOptions options, uint64_t seed)>;
+
+  // The build function is only called on the background thread. Every map
+  // gets its own seed derived from the given one.
+  MapPipeline(BuildFn build,
+              std::vector<std::vector<palettes::Colour3f>> palettes,
+              uint64_t seed = 0);
+
+  MapPipeline(const MapPipeline&) = delete;
+
+  MapPipeline& operator=(const MapPipeline&) = delete;
+
+  ~MapPipeline();
+
+  // Makes the spec the one of the next map; cheap when it has not changed.
+  void Prepare(const MapSpec& spec);
+
+  // Returns the map for the spec, waiting for it if it is not ready yet.
+  // Rethrows the error of the build, if any.
+  [[nodiscard]] PreparedMap Take(const MapSpec& spec);
+
+ private:
+  // Updates the wanted spec; mutex_ must be held.
+  void Want(const MapSpec& spec);
+
+  void BuildLoop();
+
+  const BuildFn build_;
+  const std::vector<std::vector<palettes::Colour3f>> palettes_;
+  const uint64_t seed_;
+
+  // The number of the builds started; only used by the background thread.
+  uint64_t builds_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::optional<MapSpec> wanted_;
+  std::optional<PreparedMap> ready_;
+  MapSpec readySpec_;
+  std::exception_ptr error_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_MAP_PIPELINE_H_
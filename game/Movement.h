@@ -0,0 +1,225 @@
+#ifndef U7_GAME_MOVEMENT_H_
+#define U7_GAME_MOVEMENT_H_
+
+#include "game/Game.h"
+#include "game/GameMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// The movement rules shared by Game and GameBatch. A player is a point on
+// the halls; it moves along the corridors, and turns only at the centre of a
+// hall. The map is either GameMap or ChunkedMap.
+namespace u7::game::movement {
+
+constexpr double kEps = 1.0 / 1024.0;
+constexpr double kBaseSpeed = 2.0;
+constexpr double kAcceleration = 15.0;
+
+// The shortest run that MoveAlong() crosses at once.
+constexpr int kMinJump = 4;
+
+// Returns the distance covered in the given time by a player with the given
+// speed, and updates the speed.
+inline double Accelerate(double& speed, double seconds) {
+  speed = std::max(speed, kBaseSpeed);
+  const double distance =
+      speed * seconds + kAcceleration * seconds * seconds / 2.0;
+  speed += kAcceleration * seconds;
+  return distance;
+}
+
+// Snaps the point to the centre of its hall across the sides that are
+// walls; returns whether the point is at the exit.
+template <typename Map>
+bool NormalizeLocation(const Map& map, double& x, double& y) {
+  const GameMap::Location mapLoc = {
+      static_cast<int>(std::round(x)),
+      static_cast<int>(std::round(y)),
+  };
+  if (!map.IsHall(mapLoc)) {
+    throw std::logic_error("player has stuck in the wall");
+  }
+  if ((y > mapLoc.y && !map.UnsafeIsHall(mapLoc.Up())) ||
+      (y < mapLoc.y && !map.UnsafeIsHall(mapLoc.Down()))) {
+    y = mapLoc.y;
+  }
+  if ((x > mapLoc.x && !map.UnsafeIsHall(mapLoc.Right())) ||
+      (x < mapLoc.x && !map.UnsafeIsHall(mapLoc.Left()))) {
+    x = mapLoc.x;
+  }
+  return std::fabs(x - mapLoc.x) < kEps && std::fabs(y - mapLoc.y) < kEps &&
+         map.GetExitLocation() == mapLoc;
+}
+
+// Moves the point by up to the given distance as the go actions direct;
+// returns false if it has stopped, so the speed is lost.
+template <typename Map>
+bool MoveAlong(const Map& map, Game::PlayerActions goActions, double& x,
+               double& y, double reachableDistance) {
+  const auto goTo = [&](Game::Location nextLoc) {
+    const double dx = nextLoc.x - x;
+    const double dy = nextLoc.y - y;
+    const double distance = std::fabs(dx) + std::fabs(dy);
+    if (distance <= reachableDistance) {
+      x = nextLoc.x;
+      y = nextLoc.y;
+      reachableDistance -= distance;
+    } else {
+      x += dx * reachableDistance / distance;
+      y += dy * reachableDistance / distance;
+      reachableDistance = 0.0;
+    }
+  };
+
+  while (reachableDistance > kEps) {
+    const GameMap::Location loc = {
+        static_cast<int>(std::round(x)),
+        static_cast<int>(std::round(y)),
+    };
+    const double fx = x - loc.x;
+    const double fy = y - loc.y;
+    Game::Location nextLoc;
+    nextLoc.x = x;
+    nextLoc.y = y;
+
+    if (goActions == Game::kPlayerGoUp) {
+      if (std::fabs(fx) < kEps) {
+        if (fy <= -kEps) {
+          nextLoc = loc;
+        } else if (map.UnsafeIsHall(loc.Up())) {
+          nextLoc = loc.Up();
+        }
+      } else if (map.UnsafeIsHall(loc.Up())) {
+        nextLoc = loc;
+      }
+    } else if (goActions == Game::kPlayerGoDown) {
+      if (std::fabs(fx) < kEps) {
+        if (fy >= kEps) {
+          nextLoc = loc;
+        } else if (map.UnsafeIsHall(loc.Down())) {
+          nextLoc = loc.Down();
+        }
+      } else if (map.UnsafeIsHall(loc.Down())) {
+        nextLoc = loc;
+      }
+    } else if (goActions == Game::kPlayerGoLeft) {
+      if (std::fabs(fy) < kEps) {
+        if (fx >= kEps) {
+          nextLoc = loc;
+        } else if (map.UnsafeIsHall(loc.Left())) {
+          nextLoc = loc.Left();
+        }
+      } else if (map.UnsafeIsHall(loc.Left())) {
+        nextLoc = loc;
+      }
+    } else if (goActions == Game::kPlayerGoRight) {
+      if (std::fabs(fy) < kEps) {
+        if (fx <= -kEps) {
+          nextLoc = loc;
+        } else if (map.UnsafeIsHall(loc.Right())) {
+          nextLoc = loc.Right();
+        }
+      } else if (map.UnsafeIsHall(loc.Right())) {
+        nextLoc = loc;
+      }
+    } else if (goActions == (Game::kPlayerGoUp | Game::kPlayerGoRight)) {
+      if (fx <= -kEps || fy <= -kEps) {
+        nextLoc = loc;
+      } else if (fy >= kEps) {
+        nextLoc = loc.Up();
+      } else if (fx >= kEps) {
+        nextLoc = loc.Right();
+      } else if (map.UnsafeIsHall(loc.Up()) && !map.UnsafeIsHall(loc.Right())) {
+        nextLoc = loc.Up();
+      } else if (!map.UnsafeIsHall(loc.Up()) && map.UnsafeIsHall(loc.Right())) {
+        nextLoc = loc.Right();
+      }
+    } else if (goActions == (Game::kPlayerGoUp | Game::kPlayerGoLeft)) {
+      if (fx >= kEps || fy <= -kEps) {
+        nextLoc = loc;
+      } else if (fy >= kEps) {
+        nextLoc = loc.Up();
+      } else if (fx <= -kEps) {
+        nextLoc = loc.Left();
+      } else if (map.UnsafeIsHall(loc.Up()) && !map.UnsafeIsHall(loc.Left())) {
+        nextLoc = loc.Up();
+      } else if (!map.UnsafeIsHall(loc.Up()) && map.UnsafeIsHall(loc.Left())) {
+        nextLoc = loc.Left();
+      }
+    } else if (goActions == (Game::kPlayerGoDown | Game::kPlayerGoRight)) {
+      if (fx <= -kEps || fy >= kEps) {
+        nextLoc = loc;
+      } else if (fy <= -kEps) {
+        nextLoc = loc.Down();
+      } else if (fx >= kEps) {
+        nextLoc = loc.Right();
+      } else if (map.UnsafeIsHall(loc.Down()) &&
+                 !map.UnsafeIsHall(loc.Right())) {
+        nextLoc = loc.Down();
+      } else if (!map.UnsafeIsHall(loc.Down()) &&
+                 map.UnsafeIsHall(loc.Right())) {
+        nextLoc = loc.Right();
+      }
+    } else if (goActions == (Game::kPlayerGoDown | Game::kPlayerGoLeft)) {
+      if (fx >= kEps || fy >= kEps) {
+        nextLoc = loc;
+      } else if (fy <= -kEps) {
+        nextLoc = loc.Down();
+      } else if (fx <= -kEps) {
+        nextLoc = loc.Left();
+      } else if (map.UnsafeIsHall(loc.Down()) &&
+                 !map.UnsafeIsHall(loc.Left())) {
+        nextLoc = loc.Down();
+      } else if (!map.UnsafeIsHall(loc.Down()) &&
+                 map.UnsafeIsHall(loc.Left())) {
+        nextLoc = loc.Left();
+      }
+    }
+    if (x == nextLoc.x && y == nextLoc.y) {
+      return false;
+    }
+    if constexpr (requires { map.HasRuns(); }) {
+      // From the centre of a hall, the run ahead is crossed at once: every
+      // hall on the way would choose the same step. With one direction, the
+      // step depends only on the hall ahead; with two, also on the hall
+      // aside, so only the straight corridors are crossed. The steps are
+      // whole, so the distance left is the same as step by step. The run is
+      // looked up only if a few halls ahead, which are cheaper to check,
+      // suggest that it is long.
+      const int dx = static_cast<int>(nextLoc.x) - loc.x;
+      const int dy = static_cast<int>(nextLoc.y) - loc.y;
+      const auto isHallAhead = [&](int steps) {
+        return map.IsHall(
+            GameMap::Location{loc.x + steps * dx, loc.y + steps * dy});
+      };
+      if (x == loc.x && y == loc.y && reachableDistance >= kMinJump &&
+          map.HasRuns() && isHallAhead(2) && isHallAhead(3) &&
+          isHallAhead(kMinJump)) {
+        const auto direction =
+            (dy > 0   ? GameMap::Direction::kUp
+             : dy < 0 ? GameMap::Direction::kDown
+             : dx < 0 ? GameMap::Direction::kLeft
+                      : GameMap::Direction::kRight);
+        const int run = (goActions.count() == 1
+                             ? map.GetHallRun(loc, direction)
+                             : map.GetCorridorRun(loc, direction));
+        const int steps = static_cast<int>(
+            std::min<double>(run, std::floor(reachableDistance)));
+        if (steps >= 2) {
+          x += steps * dx;
+          y += steps * dy;
+          reachableDistance -= steps;
+          continue;
+        }
+      }
+    }
+    goTo(nextLoc);
+  }
+  return true;
+}
+
+}  // namespace u7::game::movement
+
+#endif  // U7_GAME_MOVEMENT_H_
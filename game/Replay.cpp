@@ -0,0 +1,216 @@
+#include "game/Replay.h"
+
+#include "algorithm/Philox.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+namespace u7::game {
+namespace {
+
+constexpr char kMagic[4] = {'U', '7', 'R', 'P'};
+constexpr uint8_t kVersion = 1;
+
+// The bits of the boolean maze options.
+constexpr uint8_t kNoLoops = 1;
+constexpr uint8_t kNoSmallSquares = 2;
+constexpr uint8_t kPruneStubs = 4;
+
+// More players than a replay may have; guards against corrupted logs.
+constexpr uint64_t kMaxPlayers = 1 << 16;
+
+// A longer side of a map, or a larger density radius, than a replay may
+// have; guards against corrupted logs too.
+constexpr uint64_t kMaxMapSide = 1 << 16;
+
+void WriteByte(std::ostream& output, uint8_t byte) {
+  output.put(static_cast<char>(byte));
+}
+
+void WriteVarint(std::ostream& output, uint64_t value) {
+  while (value >= 0x80) {
+    WriteByte(output, static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  WriteByte(output, static_cast<uint8_t>(value));
+}
+
+void WriteFixed64(std::ostream& output, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    WriteByte(output, static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+uint8_t ReadByte(std::istream& input) {
+  const auto byte = input.get();
+  if (byte == std::istream::traits_type::eof()) {
+    throw std::runtime_error("truncated replay log");
+  }
+  return static_cast<uint8_t>(byte);
+}
+
+uint64_t ReadVarint(std::istream& input) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const uint8_t byte = ReadByte(input);
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return result;
+    }
+  }
+  throw std::runtime_error("malformed varint in replay log");
+}
+
+uint64_t ReadFixed64(std::istream& input) {
+  uint64_t result = 0;
+  for (int i = 0; i < 8; ++i) {
+    result |= static_cast<uint64_t>(ReadByte(input)) << (8 * i);
+  }
+  return result;
+}
+
+void WriteReplayMap(std::ostream& output, const ReplayMap& map) {
+  WriteFixed64(output, map.seed);
+  WriteVarint(output, map.width);
+  WriteVarint(output, map.height);
+  WriteByte(output, (map.options.noLoops ? kNoLoops : 0) |
+                        (map.options.noSmallSquares ? kNoSmallSquares : 0) |
+                        (map.options.pruneStubs ? kPruneStubs : 0));
+  WriteVarint(output, map.options.limitDensityR);
+  WriteVarint(output, map.options.limitDensityThreshold);
+  WriteByte(output, static_cast<uint8_t>(map.options.queue));
+  WriteByte(output, static_cast<uint8_t>(map.options.engine));
+}
+
+ReplayMap ReadReplayMap(std::istream& input) {
+  ReplayMap result;
+  result.seed = ReadFixed64(input);
+  const uint64_t width = ReadVarint(input);
+  const uint64_t height = ReadVarint(input);
+  if (width > kMaxMapSide || height > kMaxMapSide ||
+      (width == 0) != (height == 0)) {
+    throw std::runtime_error("bad map size in replay log");
+  }
+  result.width = static_cast<int>(width);
+  result.height = static_cast<int>(height);
+  const uint8_t flags = ReadByte(input);
+  if ((flags & ~(kNoLoops | kNoSmallSquares | kPruneStubs)) != 0) {
+    throw std::runtime_error("bad map flags in replay log");
+  }
+  result.options.noLoops = (flags & kNoLoops) != 0;
+  result.options.noSmallSquares = (flags & kNoSmallSquares) != 0;
+  result.options.pruneStubs = (flags & kPruneStubs) != 0;
+  const uint64_t limitDensityR = ReadVarint(input);
+  if (limitDensityR > kMaxMapSide) {
+    throw std::runtime_error("bad density radius in replay log");
+  }
+  result.options.limitDensityR = static_cast<int>(limitDensityR);
+  result.options.limitDensityThreshold = ReadVarint(input);
+  const uint8_t queue = ReadByte(input);
+  if (queue != static_cast<uint8_t>(maze::GenMazeQueue::kBinaryHeap) &&
+      queue != static_cast<uint8_t>(maze::GenMazeQueue::kBucket)) {
+    throw std::runtime_error("bad maze queue in replay log");
+  }
+  result.options.queue = static_cast<maze::GenMazeQueue>(queue);
+  const uint8_t engine = ReadByte(input);
+  if (engine != static_cast<uint8_t>(maze::GenMazeEngine::kGrowth) &&
+      engine != static_cast<uint8_t>(maze::GenMazeEngine::kKruskal)) {
+    throw std::runtime_error("bad maze engine in replay log");
+  }
+  result.options.engine = static_cast<maze::GenMazeEngine>(engine);
+  return result;
+}
+
+}  // namespace
+
+std::shared_ptr<GameMap> GenReplayMap(const ReplayMap& map,
+                                      GameMapOptions mapOptions) {
+  if (map.IsEndless()) {
+    throw std::runtime_error("the map of the replay is endless");
+  }
+  algorithm::Philox4x32 rng(map.seed);
+  return GenGameMap(
+      map.width, map.height, [&rng] { return static_cast<int>(rng()); },
+      map.options, mapOptions);
+}
+
+ReplayRound::ReplayRound(ReplayMap map, int players)
+    : map_(std::move(map)), players_(players) {
+  if (players <= 0) {
+    throw std::runtime_error("a replay round needs a player");
+  }
+}
+
+void ReplayRound::Append(std::span<const Game::PlayerActions> actions,
+                         uint64_t ticks) {
+  if (actions.size() != static_cast<size_t>(players_)) {
+    throw std::runtime_error("expected the actions of every player");
+  }
+  if (ticks == 0) {
+    return;
+  }
+  ticks_ += ticks;
+  if (!runLengths_.empty() &&
+      std::equal(actions.begin(), actions.end(),
+                 runActions_.end() - players_)) {
+    runLengths_.back() += ticks;
+    return;
+  }
+  runLengths_.push_back(ticks);
+  runActions_.insert(runActions_.end(), actions.begin(), actions.end());
+}
+
+void WriteReplay(std::ostream& output, const Replay& replay) {
+  output.write(kMagic, sizeof(kMagic));
+  WriteByte(output, kVersion);
+  WriteFixed64(output, std::bit_cast<uint64_t>(replay.tickSeconds));
+  WriteVarint(output, replay.rounds.size());
+  for (const auto& round : replay.rounds) {
+    WriteReplayMap(output, round.GetMap());
+    WriteVarint(output, round.GetPlayers());
+    WriteVarint(output, round.GetRuns());
+    round.ForEachRun([&](uint64_t ticks, auto actions) {
+      WriteVarint(output, ticks);
+      for (const auto& playerActions : actions) {
+        WriteByte(output, static_cast<uint8_t>(playerActions.to_ulong()));
+      }
+    });
+  }
+}
+
+Replay ReadReplay(std::istream& input) {
+  char magic[sizeof(kMagic)];
+  if (!input.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), kMagic)) {
+    throw std::runtime_error("not a replay log");
+  }
+  if (ReadByte(input) != kVersion) {
+    throw std::runtime_error("unsupported replay log version");
+  }
+  Replay result;
+  result.tickSeconds = std::bit_cast<double>(ReadFixed64(input));
+  const uint64_t rounds = ReadVarint(input);
+  for (uint64_t r = 0; r < rounds; ++r) {
+    ReplayMap map = ReadReplayMap(input);
+    const uint64_t players = ReadVarint(input);
+    if (players == 0 || players > kMaxPlayers) {
+      throw std::runtime_error("bad number of players in replay log");
+    }
+    ReplayRound& round =
+        result.rounds.emplace_back(map, static_cast<int>(players));
+    std::vector<Game::PlayerActions> actions(players);
+    const uint64_t runs = ReadVarint(input);
+    for (uint64_t i = 0; i < runs; ++i) {
+      const uint64_t ticks = ReadVarint(input);
+      for (auto& playerActions : actions) {
+        playerActions = ReadByte(input);
+      }
+      round.Append(actions, ticks);
+    }
+  }
+  return result;
+}
+
+}  // namespace u7::game
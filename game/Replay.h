@@ -0,0 +1,88 @@
+#ifndef U7_GAME_REPLAY_H_
+#define U7_GAME_REPLAY_H_
+
+#include "game/Game.h"
+#include "maze/Maze.h"
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace u7::game {
+
+// The map a round is played on: a map of the given size, or the endless
+// world if the size is zero. The map is generated as
+//
+//   algorithm::Philox4x32 rng(seed);
+//   GenGameMap(width, height, [&] { return static_cast<int>(rng()); },
+//              options);
+//
+// which is the same map as GenGameMap<options>(width, height, rng).
+struct ReplayMap {
+  uint64_t seed = 0;
+  int width = 0;
+  int height = 0;
+  maze::GenMazeOptions options;
+
+  [[nodiscard]] bool IsEndless() const { return width == 0 && height == 0; }
+};
+
+std::shared_ptr<GameMap> GenReplayMap(const ReplayMap& map,
+                                      GameMapOptions mapOptions = {});
+
+// The actions of every player on one map, tick by tick. The players mostly
+// hold their keys for many ticks, so the ticks are kept as runs of the same
+// actions.
+class ReplayRound {
+ public:
+  ReplayRound(ReplayMap map, int players);
+
+  [[nodiscard]] const ReplayMap& GetMap() const { return map_; }
+
+  [[nodiscard]] int GetPlayers() const { return players_; }
+
+  [[nodiscard]] uint64_t GetTicks() const { return ticks_; }
+
+  [[nodiscard]] size_t GetRuns() const { return runLengths_.size(); }
+
+  // Appends the actions of every player, held for the given number of ticks.
+  void Append(std::span<const Game::PlayerActions> actions,
+              uint64_t ticks = 1);
+
+  // Calls fn(ticks, actions) for every run, in order.
+  template <typename Fn>
+  void ForEachRun(Fn&& fn) const {
+    for (size_t i = 0; i < runLengths_.size(); ++i) {
+      fn(runLengths_[i], std::span<const Game::PlayerActions>(
+                             runActions_.data() + i * players_, players_));
+    }
+  }
+
+ private:
+  ReplayMap map_;
+  int players_;
+  uint64_t ticks_ = 0;
+  std::vector<uint64_t> runLengths_;
+  std::vector<Game::PlayerActions> runActions_;
+};
+
+// A recorded session: the rounds in the order they were played, all with the
+// same tick.
+struct Replay {
+  double tickSeconds = 0.0;
+  std::vector<ReplayRound> rounds;
+};
+
+// The log is binary: a header, and then every round as its map, followed by
+// the runs; a run is its length and a byte of actions per player. The
+// integers are LEB128 varints.
+void WriteReplay(std::ostream& output, const Replay& replay);
+
+Replay ReadReplay(std::istream& input);
+
+}  // namespace u7::game
+
+#endif  // U7_GAME_REPLAY_H_
@@ -1,24 +1,48 @@
 //
 // Created by Alexander G. Pronchenkov on 27.01.2023.
 //
+#include "algorithm/Philox.h"
+#include "game/ChunkedMap.h"
+#include "game/FixedStep.h"
 #include "game/Game.h"
 #include "game/Glyph.h"
+#include "game/MapPipeline.h"
+#include "game/Replay.h"
 #include "game/SceneView.h"
 #include "palettes/Palettes.h"
 
 #define GL_SILENCE_DEPRECATION
 #include <GLFW/glfw3.h>
+#include <array>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <random>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <span>
+#include <string>
+#include <utility>
+#include <vector>
 
+using ::u7::algorithm::Philox4x32;
+using ::u7::game::ChunkedMap;
+using ::u7::game::FixedStep;
 using ::u7::game::Game;
 using ::u7::game::GameMap;
+using ::u7::game::GameMapOptions;
 using ::u7::game::GenGameMap;
 using ::u7::game::GetStandardGlyph;
 using ::u7::game::Glyph;
+using ::u7::game::Interpolate;
+using ::u7::game::MapMesh;
+using ::u7::game::MapPipeline;
+using ::u7::game::MapSpec;
+using ::u7::game::Replay;
+using ::u7::game::ReplayMap;
+using ::u7::game::WriteReplay;
 using ::u7::game::SceneCoord;
 using ::u7::game::SceneView;
 using ::u7::maze::GenMazeOptions;
@@ -37,49 +61,116 @@ constexpr GenMazeOptions kGenMazeOptions{
 
 constexpr int kScoreFontSize = 8;
 
-void DrawGameMap(const GameMap& map, std::span<const Colour3f> palette,
+void DrawExit(GameMap::Location loc, Colour3f exitColour) {
+  glBegin(GL_QUADS);
+  glColor3f(exitColour.r, exitColour.g, exitColour.b);
+  glVertex3f(loc.x - 0.5f, loc.y - 0.5f, 1.0f);
+  glVertex3f(loc.x + 0.5f, loc.y - 0.5f, 1.0f);
+  glVertex3f(loc.x + 0.5f, loc.y + 0.5f, 1.0f);
+  glVertex3f(loc.x - 0.5f, loc.y + 0.5f, 1.0f);
+  glEnd();
+  glColor3f(exitColour.r, exitColour.g, exitColour.b);
+  glBegin(GL_LINE_LOOP);
+  glVertex3f(loc.x - 0.7f, loc.y - 0.7f, 1.0f);
+  glVertex3f(loc.x + 0.7f, loc.y - 0.7f, 1.0f);
+  glVertex3f(loc.x + 0.7f, loc.y + 0.7f, 1.0f);
+  glVertex3f(loc.x - 0.7f, loc.y + 0.7f, 1.0f);
+  glEnd();
+}
+
+// Draws the first steps of the shortest path from the player to the exit.
+void DrawHint(const GameMap& map, const Game::PlayerState& playerState,
+              Colour3f colour) {
+  constexpr int kHintLength = 24;
+  const GameMap::Location start{
+      static_cast<int>(std::lround(playerState.location.x)),
+      static_cast<int>(std::lround(playerState.location.y))};
+  glColor3f(colour.r, colour.g, colour.b);
+  glBegin(GL_LINE_STRIP);
+  int steps = 0;
+  for (const auto loc : map.GetPathToExit(start)) {
+    glVertex3f(loc.x, loc.y, 0.5f);
+    if (++steps > kHintLength) {
+      break;
+    }
+  }
+  glEnd();
+}
+
+// Draws the mesh of the map with the colours of the given palette.
+void DrawMapMesh(const GameMap& map, const MapMesh& mesh, size_t palette,
                  Colour3f exitColour) {
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_INT, 0, mesh.vertices.data());
+  glColorPointer(3, GL_UNSIGNED_BYTE, 0, mesh.colours[palette].data());
+  glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(mesh.vertices.size() / 2));
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  DrawExit(map.GetExitLocation(), exitColour);
+}
+
+// Draws the visible part of the endless map. Never waits for a chunk: a
+// chunk that is not generated yet is drawn as the outline of its square
+// until the background thread has made it.
+void DrawChunkedMap(const ChunkedMap& map, SceneCoord bottomLeft,
+                    SceneCoord topRight, Colour3f colour,
+                    Colour3f exitColour) {
+  const int left = static_cast<int>(std::floor(bottomLeft.x));
+  const int bottom = static_cast<int>(std::floor(bottomLeft.y));
+  const int right = static_cast<int>(std::ceil(topRight.x));
+  const int top = static_cast<int>(std::ceil(topRight.y));
+  const int s = map.GetChunkSize();
   glBegin(GL_LINES);
-  const auto colour = [&](GameMap::Location loc) {
-    return GetColour(1.0f - (0.0625f + map.GetDistanceToExit(loc)) /
-                                (0.0625f + map.MaxDistanceToExit()),
-                     palette);
-  };
-  for (int x = 0; x < map.GetWidth(); ++x) {
-    for (int y = 0; y < map.GetHeight(); ++y) {
-      const GameMap::Location loc{x, y};
-      if (map.IsHall(loc)) {
-        const auto locColour = colour(loc);
-        for (auto newLoc : {loc.Right(), loc.Up()}) {
-          if (map.IsHall(newLoc)) {
-            const auto newLocColour = colour(newLoc);
-            glColor3f(locColour.r, locColour.g, locColour.b);
-            glVertex2i(loc.x, loc.y);
-            glColor3f(newLocColour.r, newLocColour.g, newLocColour.b);
-            glVertex2i(newLoc.x, newLoc.y);
+  glColor3f(colour.r, colour.g, colour.b);
+  for (int cx = map.ChunkOf(left); cx <= map.ChunkOf(right); ++cx) {
+    for (int cy = map.ChunkOf(bottom); cy <= map.ChunkOf(top); ++cy) {
+      const auto chunk = map.TryGetChunk(cx, cy);
+      if (!chunk) {
+        glColor3f(colour.r / 2, colour.g / 2, colour.b / 2);
+        for (const auto [x0, y0, x1, y1] :
+             {std::array{0, 0, s, 0}, std::array{s, 0, s, s},
+              std::array{s, s, 0, s}, std::array{0, s, 0, 0}}) {
+          glVertex2i(cx * s + x0, cy * s + y0);
+          glVertex2i(cx * s + x1, cy * s + y1);
+        }
+        glColor3f(colour.r, colour.g, colour.b);
+        continue;
+      }
+      // The corridors across the right and the top sides are drawn only
+      // once the neighbour is there too.
+      const auto rightChunk = map.TryGetChunk(cx + 1, cy);
+      const auto topChunk = map.TryGetChunk(cx, cy + 1);
+      const auto isHall = [&](int x, int y) {
+        if (x == s) {
+          return rightChunk && rightChunk->UnsafeAt(y, 0);
+        }
+        if (y == s) {
+          return topChunk && topChunk->UnsafeAt(0, x);
+        }
+        return chunk->UnsafeAt(y, x);
+      };
+      for (int x = std::max(left - cx * s, 0);
+           x <= std::min(right - cx * s, s - 1); ++x) {
+        for (int y = std::max(bottom - cy * s, 0);
+             y <= std::min(top - cy * s, s - 1); ++y) {
+          if (!chunk->UnsafeAt(y, x)) {
+            continue;
+          }
+          if (isHall(x + 1, y)) {
+            glVertex2i(cx * s + x, cy * s + y);
+            glVertex2i(cx * s + x + 1, cy * s + y);
+          }
+          if (isHall(x, y + 1)) {
+            glVertex2i(cx * s + x, cy * s + y);
+            glVertex2i(cx * s + x, cy * s + y + 1);
           }
         }
       }
     }
   }
   glEnd();
-  {
-    const auto loc = map.GetExitLocation();
-    glBegin(GL_QUADS);
-    glColor3f(exitColour.r, exitColour.g, exitColour.b);
-    glVertex3f(loc.x - 0.5f, loc.y - 0.5f, 1.0f);
-    glVertex3f(loc.x + 0.5f, loc.y - 0.5f, 1.0f);
-    glVertex3f(loc.x + 0.5f, loc.y + 0.5f, 1.0f);
-    glVertex3f(loc.x - 0.5f, loc.y + 0.5f, 1.0f);
-    glEnd();
-    glColor3f(exitColour.r, exitColour.g, exitColour.b);
-    glBegin(GL_LINE_LOOP);
-    glVertex3f(loc.x - 0.7f, loc.y - 0.7f, 1.0f);
-    glVertex3f(loc.x + 0.7f, loc.y - 0.7f, 1.0f);
-    glVertex3f(loc.x + 0.7f, loc.y + 0.7f, 1.0f);
-    glVertex3f(loc.x - 0.7f, loc.y + 0.7f, 1.0f);
-    glEnd();
-  }
+  DrawExit(map.GetExitLocation(), exitColour);
 }
 
 void DrawSquare() {
@@ -155,56 +246,167 @@ void Print(std::string_view message) {
   }
 }
 
+// The controls and the looks of a player.
+struct PlayerSetup {
+  int keyUp;
+  int keyDown;
+  int keyLeft;
+  int keyRight;
+  int keyAsk1;
+  int keyAsk2;
+  int gamepadId;
+  void (*drawPoints)();
+  Colour3f colour;
+  float z;
+};
+
+const PlayerSetup kPlayerSetups[] = {
+    {GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT,
+     GLFW_KEY_LEFT_SHIFT, GLFW_KEY_RIGHT_SHIFT, GLFW_JOYSTICK_1,
+     &DrawCircle<5, 1>, Colour3f{0.94f, 0.72f, 0.82f}, 3.0f},
+    {GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_LEFT_SHIFT,
+     GLFW_KEY_RIGHT_SHIFT, GLFW_JOYSTICK_2, &DrawCircle<5, -1>,
+     Colour3f{0.91f, 0.34f, 0.57f}, 2.0f},
+};
+
+constexpr int kPlayers = std::size(kPlayerSetups);
+
 int globalGameScore;
-std::shared_ptr<Game> globalGame1;
-std::shared_ptr<Game> globalGame2;
+bool globalEndlessMode;
+std::shared_ptr<ChunkedMap> globalWorld;
+std::shared_ptr<Game> globalGame;
 double globalLastGameActionTimePointSeconds;
 
+// The players move by whole ticks and are drawn between the last two.
+FixedStep globalFixedStep;
+std::vector<Game::Location> globalPreviousPlayerLocations;
+
+// The session being recorded with --record.
+std::optional<Replay> globalReplay;
+std::string globalReplayPath;
+
 enum Palette { DEFAULT, CUBEHELIX, HEATMAP };
 GLuint globalSceneDisplayLists;
+std::unique_ptr<MapPipeline> globalMapPipeline;
 
 SceneView globalSceneView;
 
-void MakeNewMap() {
-  static std::mt19937 rng;
+void PrefetchVisibleChunks() {
+  if (globalWorld) {
+    const auto bottomLeft = globalSceneView.GetBottomLeft();
+    const auto topRight = globalSceneView.GetTopRight();
+    globalWorld->Prefetch(
+        {static_cast<int>(std::floor(bottomLeft.x)),
+         static_cast<int>(std::floor(bottomLeft.y))},
+        {static_cast<int>(std::ceil(topRight.x)),
+         static_cast<int>(std::ceil(topRight.y))});
+  }
+}
+
+// The palettes in the order of Palette.
+std::vector<std::vector<Colour3f>> GetScenePalettes() {
+  const auto heatmapPalette = GetHeatmap5Palette();
+  return {
+      {Colour3f{147 / 255.0f, 147 / 255.0f, 147 / 255.0f}},
+      GetCubehelixPalette(256, /*begin=*/0.1, /*end=*/0.95),
+      {heatmapPalette.begin(), heatmapPalette.end()},
+  };
+}
+
+std::unique_ptr<MapPipeline> MakeMapPipeline() {
+  return std::make_unique<MapPipeline>(
+      [](int width, int height, GameMapOptions options, uint64_t seed) {
+        Philox4x32 rng(seed);
+        return GenGameMap<kGenMazeOptions>(width, height, rng, options);
+      },
+      GetScenePalettes());
+}
+
+// The map that fills the screen at the current scale.
+MapSpec GetScreenMapSpec() {
   const auto screenScale = globalSceneView.GetScreenScale();
   const auto screenWidth = globalSceneView.GetScreenWidth();
   const auto screenHeight = globalSceneView.GetScreenHeight();
-  const int width = std::max<int>(
-      (screenWidth - SceneView::kInnerScreenMargin) * screenScale, 3);
-  const int height = std::max<int>(
-      (screenHeight - SceneView::kInnerScreenMargin) * screenScale, 3);
-  auto gameMap =
-      GenGameMap(width, height, [&] { return rng(); }, kGenMazeOptions);
+  return MapSpec{
+      .width = std::max<int>(
+          (screenWidth - SceneView::kInnerScreenMargin) * screenScale, 3),
+      .height = std::max<int>(
+          (screenHeight - SceneView::kInnerScreenMargin) * screenScale, 3),
+      .options = {.directionsToExit = true, .runs = true},
+  };
+}
+
+// Starts the ticks of the new games from now.
+void ResetGameClock() {
+  globalLastGameActionTimePointSeconds = glfwGetTime();
+  globalFixedStep.Reset();
+  globalPreviousPlayerLocations.resize(globalGame->GetPlayers());
+  for (int i = 0; i < globalGame->GetPlayers(); ++i) {
+    globalPreviousPlayerLocations[i] = globalGame->GetPlayerState(i).location;
+  }
+}
+
+// The state of the player as drawn: between the last two ticks.
+Game::PlayerState GetDrawnPlayerState(int player) {
+  auto result = globalGame->GetPlayerState(player);
+  result.location = Interpolate(globalPreviousPlayerLocations[player],
+                                result.location, globalFixedStep.GetAlpha());
+  return result;
+}
+
+// Starts recording the actions on the new map.
+void StartReplayRound(const ReplayMap& map) {
+  if (globalReplay) {
+    globalReplay->rounds.emplace_back(map, kPlayers);
+  }
+}
+
+void MakeNewMap() {
+  static Philox4x32 rng;
+  if (globalEndlessMode) {
+    const uint64_t seedHigh = rng();
+    const uint64_t seedLow = rng();
+    const uint64_t seed = seedHigh << 32 | seedLow;
+    globalWorld = std::make_shared<ChunkedMap>(seed, kGenMazeOptions);
+    StartReplayRound(ReplayMap{.seed = seed, .options = kGenMazeOptions});
+    globalGame = std::make_shared<Game>(globalWorld, kPlayers);
+    const auto entrance = globalWorld->GetEntranceLocation();
+    globalSceneView.SetSceneViewCentre(SceneCoord{
+        static_cast<double>(entrance.x), static_cast<double>(entrance.y)});
+    PrefetchVisibleChunks();
+    ResetGameClock();
+    return;
+  }
+  globalWorld.reset();
+  // The map and its mesh are usually built in the background by now, so
+  // only the display lists are compiled here.
+  auto [gameMap, mesh, seed] = globalMapPipeline->Take(GetScreenMapSpec());
+  StartReplayRound(ReplayMap{
+      .seed = seed,
+      .width = gameMap->GetWidth(),
+      .height = gameMap->GetHeight(),
+      .options = kGenMazeOptions,
+  });
   {
-    static const auto defaultPalette = {
-        Colour3f{147 / 255.0f, 147 / 255.0f, 147 / 255.0f}};
-    static const auto defaultExitColour =
-        Colour3f{252 / 255.0f, 246 / 255.0f, 182 / 255.0f};
-    glNewList(globalSceneDisplayLists + Palette::DEFAULT, GL_COMPILE);
-    DrawGameMap(*gameMap, defaultPalette, defaultExitColour);
-    glEndList();
-
-    static const auto cubehelixPalette =
-        GetCubehelixPalette(256, /*begin=*/0.1, /*end=*/0.95);
-    static const auto cubehelixExitColour = GetColour(1.0f, cubehelixPalette);
-    glNewList(globalSceneDisplayLists + Palette::CUBEHELIX, GL_COMPILE);
-    DrawGameMap(*gameMap, cubehelixPalette, cubehelixExitColour);
-    glEndList();
-
-    static const auto heatmapPalette = GetHeatmap5Palette();
-    static const auto heatmapExitColour = GetColour(1.0f, heatmapPalette);
-    glNewList(globalSceneDisplayLists + Palette::HEATMAP, GL_COMPILE);
-    DrawGameMap(*gameMap, heatmapPalette, heatmapExitColour);
-    glEndList();
+    static const auto palettes = GetScenePalettes();
+    static const Colour3f exitColours[] = {
+        Colour3f{252 / 255.0f, 246 / 255.0f, 182 / 255.0f},
+        GetColour(1.0f, palettes[Palette::CUBEHELIX]),
+        GetColour(1.0f, palettes[Palette::HEATMAP]),
+    };
+    for (auto palette : {Palette::DEFAULT, Palette::CUBEHELIX,
+                         Palette::HEATMAP}) {
+      glNewList(globalSceneDisplayLists + palette, GL_COMPILE);
+      DrawMapMesh(*gameMap, mesh, palette, exitColours[palette]);
+      glEndList();
+    }
   }
-  globalGame1 = std::make_shared<Game>(gameMap);
-  globalGame2 = std::make_shared<Game>(gameMap);
+  globalGame = std::make_shared<Game>(gameMap, kPlayers);
   globalSceneView.SetSceneViewCentre(SceneCoord{
       (gameMap->GetWidth() - 1) / 2.0, (gameMap->GetHeight() - 1) / 2.0});
   globalSceneView.ProcessPointOfInterest(gameMap->GetEntranceLocation().x,
                                          gameMap->GetEntranceLocation().y);
-  globalLastGameActionTimePointSeconds = glfwGetTime();
+  ResetGameClock();
 }
 
 void FramebufferSizeCallback(GLFWwindow* /*window*/, int width, int height) {
@@ -217,8 +419,6 @@ void KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action,
   if (action != GLFW_PRESS && action != GLFW_REPEAT) {
     return;
   }
-  const auto player1Loc = globalGame1->GetPlayerState().location;
-  const auto player2Loc = globalGame2->GetPlayerState().location;
   switch (key) {
     case GLFW_KEY_ESCAPE:
       glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -228,14 +428,21 @@ void KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action,
       MakeNewMap();
       return;
 
+    case GLFW_KEY_E:
+      globalEndlessMode = !globalEndlessMode;
+      MakeNewMap();
+      return;
+
     case GLFW_KEY_MINUS:
       globalSceneView.ZoomOut();
       return;
 
     case GLFW_KEY_EQUAL:
       globalSceneView.ZoomIn();
-      globalSceneView.ProcessPointOfInterest(player2Loc.x, player2Loc.y);
-      globalSceneView.ProcessPointOfInterest(player1Loc.x, player1Loc.y);
+      for (int i = globalGame->GetPlayers() - 1; i >= 0; --i) {
+        const auto loc = globalGame->GetPlayerState(i).location;
+        globalSceneView.ProcessPointOfInterest(loc.x, loc.y);
+      }
       return;
 
     default:
@@ -244,33 +451,31 @@ void KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action,
 }
 
 void KeyH(GLFWwindow* window) {
-  const auto readPlayerActions = [&](int keyUp, int keyDown, int keyLeft,
-                                     int keyRight, int keyAsk1, int keyAsk2,
-                                     int gamepadId) {
+  const auto readPlayerActions = [&](const PlayerSetup& setup) {
     Game::PlayerActions result;
     {  // Keyboard
-      if (glfwGetKey(window, keyUp) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyUp) == GLFW_PRESS) {
         result |= Game::kPlayerGoUp;
       }
-      if (glfwGetKey(window, keyDown) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyDown) == GLFW_PRESS) {
         result |= Game::kPlayerGoDown;
       }
-      if (glfwGetKey(window, keyLeft) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyLeft) == GLFW_PRESS) {
         result |= Game::kPlayerGoLeft;
       }
-      if (glfwGetKey(window, keyRight) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyRight) == GLFW_PRESS) {
         result |= Game::kPlayerGoRight;
       }
-      if (glfwGetKey(window, keyAsk1) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyAsk1) == GLFW_PRESS) {
         result |= Game::kPlayerAsk1;
       }
-      if (glfwGetKey(window, keyAsk2) == GLFW_PRESS) {
+      if (glfwGetKey(window, setup.keyAsk2) == GLFW_PRESS) {
         result |= Game::kPlayerAsk2;
       }
     }
     // Gamepad
     if (GLFWgamepadstate gamepadState;
-        glfwGetGamepadState(gamepadId, &gamepadState)) {
+        glfwGetGamepadState(setup.gamepadId, &gamepadState)) {
       if (gamepadState.buttons[GLFW_GAMEPAD_BUTTON_DPAD_UP] == GLFW_PRESS) {
         result |= Game::kPlayerGoUp;
       }
@@ -324,36 +529,44 @@ void KeyH(GLFWwindow* window) {
     return result;
   };
 
-  const auto player1Actions = readPlayerActions(                  //
-      GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT,  //
-      GLFW_KEY_LEFT_SHIFT, GLFW_KEY_RIGHT_SHIFT,                  //
-      GLFW_JOYSTICK_1);
-  const auto player2Actions = readPlayerActions(       //
-      GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D,  //
-      GLFW_KEY_LEFT_SHIFT, GLFW_KEY_RIGHT_SHIFT,       //
-      GLFW_JOYSTICK_2);
+  Game::PlayerActions playerActions[kPlayers];
+  for (int i = 0; i < kPlayers; ++i) {
+    playerActions[i] = readPlayerActions(kPlayerSetups[i]);
+  }
 
   const auto now = glfwGetTime();
   const auto secondsElapse =
       (now - std::exchange(globalLastGameActionTimePointSeconds, now));
 
-  const auto game1 = globalGame1;
-  const auto game2 = globalGame2;
-  game1->ApplyPlayerActions(player1Actions, secondsElapse);
-  game2->ApplyPlayerActions(player2Actions, secondsElapse);
-  const auto player1Loc = game1->GetPlayerState().location;
-  const auto player2Loc = game2->GetPlayerState().location;
-  globalSceneView.ProcessPointOfInterest(player1Loc.x, player1Loc.y);
-  globalSceneView.ProcessPointOfInterest(player2Loc.x, player2Loc.y);
+  const auto game = globalGame;
+  for (int ticks = globalFixedStep.Advance(secondsElapse); ticks > 0;
+       --ticks) {
+    for (int i = 0; i < game->GetPlayers(); ++i) {
+      globalPreviousPlayerLocations[i] = game->GetPlayerState(i).location;
+    }
+    if (globalReplay) {
+      globalReplay->rounds.back().Append(playerActions);
+    }
+    game->ApplyPlayerActions(playerActions, globalFixedStep.GetTickSeconds());
+  }
+  for (int i = 0; i < game->GetPlayers(); ++i) {
+    const auto loc = GetDrawnPlayerState(i).location;
+    globalSceneView.ProcessPointOfInterest(loc.x, loc.y);
+  }
+  PrefetchVisibleChunks();
 }
 
 void Draw() {
-  const auto player1State = globalGame1->GetPlayerState();
-  const auto player2State = globalGame2->GetPlayerState();
+  std::vector<Game::PlayerState> playerStates(globalGame->GetPlayers());
+  bool ask1 = false;
+  bool ask2 = false;
+  for (int i = 0; i < globalGame->GetPlayers(); ++i) {
+    playerStates[i] = GetDrawnPlayerState(i);
+    ask1 = (ask1 || playerStates[i].ask1);
+    ask2 = (ask2 || playerStates[i].ask2);
+  }
   const auto bottomLeft = globalSceneView.GetBottomLeft();
   const auto topRight = globalSceneView.GetTopRight();
-  const auto ask1 = (player1State.ask1 || player2State.ask1);
-  const auto ask2 = (player1State.ask2 || player2State.ask2);
   auto palette = Palette::DEFAULT;
   if (ask1 && !ask2) {
     palette = Palette::CUBEHELIX;
@@ -367,11 +580,26 @@ void Draw() {
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
   glOrtho(bottomLeft.x, topRight.x, bottomLeft.y, topRight.y, -5.0, 5.0);
-  glCallList(globalSceneDisplayLists + palette);
-  DrawGamePlayer(&DrawCircle<5, 1>, player1State, Colour3f{0.94f, 0.72f, 0.82f},
-                 3.0f);
-  DrawGamePlayer(&DrawCircle<5, -1>, player2State,
-                 Colour3f{0.91f, 0.34f, 0.57f}, 2.0f);
+  if (globalWorld) {
+    static const auto endlessColour =
+        Colour3f{147 / 255.0f, 147 / 255.0f, 147 / 255.0f};
+    static const auto endlessExitColour =
+        Colour3f{252 / 255.0f, 246 / 255.0f, 182 / 255.0f};
+    DrawChunkedMap(*globalWorld, bottomLeft, topRight, endlessColour,
+                   endlessExitColour);
+  } else {
+    glCallList(globalSceneDisplayLists + palette);
+  }
+  if (ask1 && ask2 && !globalWorld) {
+    const auto& map = globalGame->GetGameMap();
+    for (int i = 0; i < globalGame->GetPlayers(); ++i) {
+      DrawHint(map, playerStates[i], kPlayerSetups[i].colour);
+    }
+  }
+  for (int i = 0; i < globalGame->GetPlayers(); ++i) {
+    const auto& setup = kPlayerSetups[i];
+    DrawGamePlayer(setup.drawPoints, playerStates[i], setup.colour, setup.z);
+  }
   {
     const auto sp = GetStandardGlyph(" ");
     glMatrixMode(GL_MODELVIEW);
@@ -415,6 +643,7 @@ int SubMain() {
   glLineWidth(2.0f);
 
   globalSceneDisplayLists = glGenLists(3);
+  globalMapPipeline = MakeMapPipeline();
 
   {
     int width, height;
@@ -426,27 +655,39 @@ int SubMain() {
 
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
+    if (!globalEndlessMode) {
+      // Follows the window size and the zoom.
+      globalMapPipeline->Prepare(GetScreenMapSpec());
+    }
     KeyH(window);
-    {
-      auto game1 = globalGame1;
-      auto game2 = globalGame2;
-      auto player1State = game1->GetPlayerState();
-      auto player2State = game2->GetPlayerState();
-      if ((player1State.touchedExit && player2State.touchedExit) ||
-          (std::fabs(player1State.location.x - player2State.location.x) < 0.5 &&
-           std::fabs(player1State.location.y - player2State.location.y) < 0.5 &&
-           (player1State.touchedExit || player2State.touchedExit))) {
-        globalGameScore += 1;
-        MakeNewMap();
-      }
+    if (globalGame->IsSolved()) {
+      globalGameScore += 1;
+      MakeNewMap();
     }
     Draw();
     glfwSwapBuffers(window);
   }
+  globalMapPipeline.reset();
+  if (globalReplay) {
+    std::ofstream output(globalReplayPath, std::ios::binary);
+    WriteReplay(output, *globalReplay);
+    if (!output) {
+      std::cerr << "Failed to write " << globalReplayPath << '\n';
+      return -1;
+    }
+  }
   return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc == 3 && std::strcmp(argv[1], "--record") == 0) {
+    globalReplayPath = argv[2];
+    globalReplay = Replay{.tickSeconds = globalFixedStep.GetTickSeconds(),
+                          .rounds = {}};
+  } else if (argc != 1) {
+    std::cerr << "Usage: " << argv[0] << " [--record <replay>]\n";
+    return -1;
+  }
   if (!glfwInit()) {
     std::cerr << "Failed to initialize GLFW\n";
     return -1;
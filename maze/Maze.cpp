@@ -3,131 +3,102 @@
 //
 #include "maze/Maze.h"
 
-#include <queue>
-#include <tuple>
-#include <vector>
-
 namespace u7::maze {
+namespace internal {
 namespace {
 
-struct Cell {
-  int weight;
-  int i;
-  int j;
-  [[nodiscard]] auto tie() const { return std::tie(weight, i, j); }
-};
+using Word = Maze::Word;
+
+// The cells with at least two of the four neighbour bits set.
+Word AtLeastTwo(Word a, Word b, Word c, Word d) {
+  return (a & b) | (c & d) | ((a ^ b) & (c ^ d));
+}
+
+// The cells with exactly one of the four neighbour bits set.
+Word ExactlyOne(Word a, Word b, Word c, Word d) {
+  return (a ^ b ^ c ^ d) & ~AtLeastTwo(a, b, c, d);
+}
 
-struct CellOrder {
-  bool operator()(const Cell& lhs, const Cell& rhs) const {
-    return lhs.tie() < rhs.tie();
+// Calls fn(k, up, left, right, down) for every word of the i-th row, where
+// the arguments are the words of the neighbour bits aligned with the cells of
+// the word k. The matrix must have a border.
+template <typename Fn>
+void ForEachWord(const Maze& a, int i, Fn&& fn) {
+  const int words = a.WordsPerRow();
+  const Word* up = a.Row(i - 1);
+  const Word* row = a.Row(i);
+  const Word* down = a.Row(i + 1);
+  for (int k = 0; k < words; ++k) {
+    const Word left =
+        (row[k] << 1) | (k > 0 ? row[k - 1] >> (Maze::kWordBits - 1) : 0);
+    const Word right =
+        (row[k] >> 1) |
+        (k + 1 < words ? row[k + 1] << (Maze::kWordBits - 1) : 0);
+    fn(k, up[k], left, right, down[k]);
   }
-};
+}
 
 }  // namespace
 
+// A stub is a hall with a single hall neighbour; it is removed if that
+// neighbour has at least two other hall neighbours that are not stubs.
+// Equivalently to the cell by cell definition, it's computed for 64 cells
+// at once:
+//
+//   stubs = halls & (exactly one neighbour in halls),
+//   junctions = halls & (at least two neighbours in halls & ~stubs),
+//   halls &= ~(stubs & (a neighbour in junctions)).
+//
+void PruneStubs(Maze& maze) {
+  const int n = maze.n();
+  // The halls that are not stubs, and the junctions; the same layout as
+  // the maze, so the words match.
+  Maze nonStubs(n, maze.m(), maze.border());
+  Maze junctions(n, maze.m(), maze.border());
+  nonStubs.Fill(false);
+  junctions.Fill(false);
+  for (int i = 0; i < n; ++i) {
+    const Word* halls = maze.Row(i);
+    Word* out = nonStubs.Row(i);
+    ForEachWord(maze, i, [&](int k, Word u, Word l, Word r, Word d) {
+      out[k] = halls[k] & ~ExactlyOne(u, l, r, d);
+    });
+  }
+  for (int i = 0; i < n; ++i) {
+    const Word* halls = maze.Row(i);
+    Word* out = junctions.Row(i);
+    ForEachWord(nonStubs, i, [&](int k, Word u, Word l, Word r, Word d) {
+      out[k] = halls[k] & AtLeastTwo(u, l, r, d);
+    });
+  }
+  for (int i = 0; i < n; ++i) {
+    Word* halls = maze.Row(i);
+    const Word* keep = nonStubs.Row(i);
+    ForEachWord(junctions, i, [&](int k, Word u, Word l, Word r, Word d) {
+      halls[k] &= keep[k] | ~(u | l | r | d);
+    });
+  }
+}
+
+}  // namespace internal
+
 Maze GenMaze(int n, int m, Rng rng, GenMazeOptions options) {
-  std::priority_queue<Cell, std::vector<Cell>, CellOrder> queue;
-  Maze result(n, m);
-  Maze marked(n, m);
-  const auto enqueue = [&](int i, int j) {
-    if (i >= 0 && i < n && j >= 0 && j < m && !marked.UnsafeAt(i, j)) {
-      marked.UnsafeAt(i, j) = true;
-      queue.push(Cell{rng(), i, j});
-    }
-  };
-  const auto at = [&](int i, int j) {
-    return (i >= 0 && i < n && j >= 0 && j < m && result.UnsafeAt(i, j));
-  };
-  const auto deg = [&](int i, int j) {
-    return at(i - 1, j) + at(i, j - 1) + at(i, j + 1) + at(i + 1, j);
-  };
-  result.Fill(false);
-  marked.Fill(false);
-  const int i0 = n / 2;
-  const int j0 = m / 2;
-  enqueue(i0, j0);
-  while (!queue.empty()) {
-    const auto [_, i, j] = queue.top();
-    queue.pop();
-    if (options.noLoops) {
-      if (deg(i, j) > 1) {
-        continue;
-      }
-    } else if (options.noSmallSquares) {
-      if ((at(i - 1, j) && at(i - 1, j - 1) && at(i, j - 1)) ||
-          (at(i, j - 1) && at(i + 1, j - 1) && at(i + 1, j)) ||
-          (at(i + 1, j) && at(i + 1, j + 1) && at(i, j + 1)) ||
-          (at(i, j + 1) && at(i - 1, j + 1) && at(i - 1, j))) {
-        continue;
-      }
-    }
-    size_t counter = 0;
-    for (int r = 1; r <= options.limitDensityR; ++r) {
-      for (int s = 0; s < r; ++s) {
-        counter += at(i - r + s, j - s) + at(i + s, j - r + s) +
-                   at(i + r - s, j + s) + at(i - s, j + r - s);
-      }
-    }
-    if (counter > options.limitDensityThreshold) {
-      continue;
-    }
-    result.UnsafeAt(i, j) = true;
-    enqueue(i - 1, j);
-    enqueue(i, j - 1);
-    enqueue(i, j + 1);
-    enqueue(i + 1, j);
+  if (options.engine == GenMazeEngine::kKruskal) {
+    return internal::GenKruskalMaze(n, m, rng, options);
   }
-  if (options.pruneStubs) {
-    marked.Fill(false);
-    for (int i = 0; i < n; ++i) {
-      for (int j = 0; j < m; ++j) {
-        if (result.UnsafeAt(i, j)) {
-          marked.UnsafeAt(i, j) = (deg(i, j) == 1);
-        }
-      }
-    }
-    for (int i = 0; i < n; ++i) {
-      for (int j = 0; j < m; ++j) {
-        if (!result.UnsafeAt(i, j)) {
-          continue;
-        }
-        int hallCnt = 0;
-        int markCnt = 0;
-        if (i > 0) {
-          hallCnt += result.UnsafeAt(i - 1, j);
-          markCnt += marked.UnsafeAt(i - 1, j);
-        }
-        if (j > 0) {
-          hallCnt += result.UnsafeAt(i, j - 1);
-          markCnt += marked.UnsafeAt(i, j - 1);
-        }
-        if (j + 1 < m) {
-          hallCnt += result.UnsafeAt(i, j + 1);
-          markCnt += marked.UnsafeAt(i, j + 1);
-        }
-        if (i + 1 < n) {
-          hallCnt += result.UnsafeAt(i + 1, j);
-          markCnt += marked.UnsafeAt(i + 1, j);
-        }
-        if (markCnt == 0 || hallCnt - markCnt <= 1) {
-          continue;
-        }
-        if (i > 0 && marked.UnsafeAt(i - 1, j)) {
-          result.UnsafeAt(i - 1, j) = false;
-        }
-        if (j > 0 && marked.UnsafeAt(i, j - 1)) {
-          result.UnsafeAt(i, j - 1) = false;
-        }
-        if (j + 1 < m && marked.UnsafeAt(i, j + 1)) {
-          result.UnsafeAt(i, j + 1) = false;
-        }
-        if (i + 1 < n && marked.UnsafeAt(i + 1, j)) {
-          result.UnsafeAt(i + 1, j) = false;
-        }
-      }
-    }
+  return internal::DispatchGrowthRules(options, [&]<typename Rules>() {
+    return internal::GenMaze<Rules>(n, m, rng, options);
+  });
+}
+
+Maze GenMaze(int n, int m, BulkRng rng, GenMazeOptions options) {
+  internal::BulkRngRef bulkRng{rng};
+  if (options.engine == GenMazeEngine::kKruskal) {
+    return internal::GenKruskalMaze(n, m, bulkRng, options);
   }
-  return result;
+  return internal::DispatchGrowthRules(options, [&]<typename Rules>() {
+    return internal::GenMaze<Rules>(n, m, bulkRng, options);
+  });
 }
 
 }  // namespace u7::maze
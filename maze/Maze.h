@@ -5,16 +5,54 @@
 #define U7_MAZE_MAZE_H_
 
 #pragma once
-#include "algorithm/Matrix.h"
+#include "algorithm/BitMatrix.h"
+#include "algorithm/BucketQueue.h"
+#include "algorithm/DiamondCounter.h"
+#include "algorithm/Hash.h"
+#include "algorithm/UnionFind.h"
 
+#include <array>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <queue>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace u7::maze {
 
-using Maze = ::u7::algorithm::Matrix<bool>;
+using Maze = ::u7::algorithm::BitMatrix;
 
 using Rng = std::function<int()>;
 
+// Fills the span with random numbers; drawing the random numbers in blocks
+// saves an indirect call per cell.
+using BulkRng = std::function<void(std::span<uint32_t>)>;
+
+// The priority queue that drives the maze growth.
+enum class GenMazeQueue {
+  // A binary heap of full-width random weights.
+  kBinaryHeap,
+  // A bucket queue of 16-bit random weights; the cells are packed into
+  // a single integer. Faster on large mazes, but produces different mazes.
+  kBucket,
+};
+
+// The maze generation algorithm.
+enum class GenMazeEngine {
+  // Randomized Prim-like growth from the centre, filtered by the rules.
+  kGrowth,
+  // Randomized Kruskal over a lattice of halls at the even rows and columns,
+  // using a disjoint-set forest; runs in near-linear time. Always produces
+  // a maze without loops and small squares, and ignores the other rules.
+  kKruskal,
+};
+
 struct GenMazeOptions {
   bool noLoops = true;
   bool noSmallSquares = true;
@@ -24,10 +62,425 @@ struct GenMazeOptions {
 
   // Remove dead ends of length=1.
   bool pruneStubs = true;
+
+  GenMazeQueue queue = GenMazeQueue::kBinaryHeap;
+
+  GenMazeEngine engine = GenMazeEngine::kGrowth;
 };
 
 Maze GenMaze(int n, int m, Rng rng, GenMazeOptions options = {});
 
+// Same as above, but the random numbers are drawn in blocks. Only the order
+// of the numbers matters, so a generator whose stream does not depend on
+// the block size, like algorithm::Philox4x32, produces the same maze as
+// GenMaze(n, m, Rng(...)) with the same seed.
+Maze GenMaze(int n, int m, BulkRng rng, GenMazeOptions options = {});
+
+// Same as GenMaze() above, but the options are fixed at compile time, so the
+// disabled rules are compiled out and the generator gets inlined:
+//
+//   algorithm::Philox4x32 rng(seed);
+//   auto maze = GenMaze<GenMazeOptions{.noLoops = false}>(n, m, rng);
+//
+// If the generator has a Fill(std::span<uint32_t>) method, the random numbers
+// are drawn in blocks.
+template <GenMazeOptions kOptions, typename RngT>
+Maze GenMaze(int n, int m, RngT&& rng);
+
+namespace internal {
+
+template <typename RngT>
+concept BulkRandomGenerator = requires(RngT& rng, std::span<uint32_t> out) {
+  rng.Fill(out);
+};
+
+// Draws the random weights of the cells, in blocks if the generator
+// supports that. A bulk generator advances by whole blocks, so it may be
+// ahead of the consumed weights afterwards.
+template <typename RngT>
+class Weights {
+ public:
+  explicit Weights(RngT& rng) : rng_(rng) {}
+
+  int operator()() {
+    if constexpr (BulkRandomGenerator<RngT>) {
+      if (next_ == kBlockSize) {
+        rng_.Fill(block_);
+        next_ = 0;
+      }
+      return static_cast<int>(block_[next_++]);
+    } else {
+      return static_cast<int>(rng_());
+    }
+  }
+
+ private:
+  static constexpr size_t kBlockSize = 256;
+
+  RngT& rng_;
+  std::array<uint32_t, kBlockSize> block_;
+  size_t next_ = kBlockSize;
+};
+
+// Adapts BulkRng to the bulk generator interface.
+struct BulkRngRef {
+  const BulkRng& rng;
+
+  void Fill(std::span<uint32_t> out) const { rng(out); }
+};
+
+struct Cell {
+  int weight;
+  int i;
+  int j;
+  [[nodiscard]] auto tie() const { return std::tie(weight, i, j); }
+};
+
+struct CellOrder {
+  bool operator()(const Cell& lhs, const Cell& rhs) const {
+    return lhs.tie() < rhs.tie();
+  }
+};
+
+// The growth frontier backed by std::priority_queue.
+class HeapFrontier {
+ public:
+  HeapFrontier(int /*n*/, int /*m*/) {}
+
+  [[nodiscard]] bool empty() const { return queue_.empty(); }
+
+  void Push(int weight, int i, int j) { queue_.push(Cell{weight, i, j}); }
+
+  std::pair<int, int> Pop() {
+    const auto [_, i, j] = queue_.top();
+    queue_.pop();
+    return {i, j};
+  }
+
+ private:
+  std::priority_queue<Cell, std::vector<Cell>, CellOrder> queue_;
+};
+
+// The growth frontier backed by a bucket queue; the cell coordinates are
+// packed into a single integer of the type Index.
+template <typename Index>
+class BucketFrontier {
+ public:
+  static constexpr int kWeightBits = 16;
+
+  [[nodiscard]] static bool Fits(int n, int m) {
+    return std::bit_width(static_cast<unsigned>(n)) +
+               std::bit_width(static_cast<unsigned>(m)) <=
+           std::numeric_limits<Index>::digits;
+  }
+
+  BucketFrontier(int /*n*/, int m)
+      : shift_(std::bit_width(static_cast<unsigned>(m))) {}
+
+  [[nodiscard]] bool empty() const { return queue_.empty(); }
+
+  // The weight is mixed before its top bits are taken, so the buckets stay
+  // evenly used by generators of a narrow range, like std::rand() or
+  // std::uniform_int_distribution(0, 1000); the mixer is a bijection, so
+  // a full-range generator stays uniform.
+  void Push(int weight, int i, int j) {
+    queue_.Push(algorithm::Mix64(static_cast<uint32_t>(weight)) >>
+                    (64 - kWeightBits),
+                (static_cast<Index>(i) << shift_) | static_cast<Index>(j));
+  }
+
+  std::pair<int, int> Pop() {
+    const Index index = queue_.Pop();
+    return {static_cast<int>(index >> shift_),
+            static_cast<int>(index & ((Index{1} << shift_) - 1))};
+  }
+
+ private:
+  int shift_;
+  algorithm::BucketQueue<Index, kWeightBits> queue_;
+};
+
+// Returns the saturation cap for the density counters; the counters saturate
+// right above the threshold, so they usually fit a byte. Zero means that the
+// threshold cannot be exceeded.
+constexpr size_t DensityCap(int limitDensityR, size_t limitDensityThreshold) {
+  const size_t r = (limitDensityR > 0 ? limitDensityR : 0);
+  const size_t maxCount = 2 * r * (r + 1);
+  return (limitDensityThreshold < maxCount ? limitDensityThreshold + 1 : 0);
+}
+
+template <size_t kCap>
+using DensityCount = std::conditional_t<
+    (kCap <= UINT8_MAX), uint8_t,
+    std::conditional_t<(kCap <= UINT16_MAX), uint16_t, uint32_t>>;
+
+// Removes dead ends of length=1.
+void PruneStubs(Maze& maze);
+
+// The rules of the maze growth, fixed at compile time.
+template <bool kNoLoopsV, bool kNoSmallSquaresV, bool kLimitDensityV,
+          GenMazeQueue kQueueV, typename CountT>
+struct GrowthRules {
+  static constexpr bool kNoLoops = kNoLoopsV;
+  static constexpr bool kNoSmallSquares = kNoSmallSquaresV;
+  static constexpr bool kLimitDensity = kLimitDensityV;
+  static constexpr GenMazeQueue kQueue = kQueueV;
+  using Count = CountT;
+};
+
+// Without loops, small squares are impossible anyway.
+template <GenMazeOptions kOptions>
+using GrowthRulesOf = GrowthRules<
+    kOptions.noLoops, (!kOptions.noLoops && kOptions.noSmallSquares),
+    (DensityCap(kOptions.limitDensityR, kOptions.limitDensityThreshold) > 0),
+    kOptions.queue,
+    DensityCount<DensityCap(kOptions.limitDensityR,
+                            kOptions.limitDensityThreshold)>>;
+
+// Calls fn.template operator()<Rules>() with the growth rules matching
+// the runtime options.
+template <typename Fn>
+decltype(auto) DispatchGrowthRules(const GenMazeOptions& options, Fn&& fn) {
+  const size_t cap =
+      DensityCap(options.limitDensityR, options.limitDensityThreshold);
+  const auto withDensity = [&]<bool kNoLoops, bool kNoSmallSquares,
+                               GenMazeQueue kQueue>() -> decltype(auto) {
+    if (cap == 0) {
+      return fn.template operator()<
+          GrowthRules<kNoLoops, kNoSmallSquares, false, kQueue, uint8_t>>();
+    }
+    if (cap <= UINT8_MAX) {
+      return fn.template operator()<
+          GrowthRules<kNoLoops, kNoSmallSquares, true, kQueue, uint8_t>>();
+    }
+    if (cap <= UINT16_MAX) {
+      return fn.template operator()<
+          GrowthRules<kNoLoops, kNoSmallSquares, true, kQueue, uint16_t>>();
+    }
+    return fn.template operator()<
+        GrowthRules<kNoLoops, kNoSmallSquares, true, kQueue, uint32_t>>();
+  };
+  const auto withLoops = [&]<GenMazeQueue kQueue>() -> decltype(auto) {
+    if (options.noLoops) {
+      return withDensity.template operator()<true, false, kQueue>();
+    }
+    if (options.noSmallSquares) {
+      return withDensity.template operator()<false, true, kQueue>();
+    }
+    return withDensity.template operator()<false, false, kQueue>();
+  };
+  if (options.queue == GenMazeQueue::kBucket) {
+    return withLoops.template operator()<GenMazeQueue::kBucket>();
+  }
+  return withLoops.template operator()<GenMazeQueue::kBinaryHeap>();
+}
+
+// A rectangle of the maze.
+struct Region {
+  int top = 0;
+  int left = 0;
+  int height = 0;
+  int width = 0;
+};
+
+// The bridges policy decides whether a cell that would join the growing tree
+// with a hall outside the region may become a hall; such a cell is not
+// expanded further. By default, there are no bridges.
+struct NoBridges {
+  static constexpr bool kEnabled = false;
+
+  bool Accept(int /*i*/, int /*j*/) { return false; }
+};
+
+template <typename Rules, typename Frontier, typename RngT, typename Bridges>
+void GrowRegionWith(Maze& maze,
+                    algorithm::DiamondCounter<typename Rules::Count>& density,
+                    size_t limitDensityThreshold, Region region, RngT& rng,
+                    Bridges& bridges) {
+  // The frontier and `marked` use the coordinates within the region. The
+  // border of `marked` is marked, and the maze has a border of walls, so
+  // the lookups below need no bounds checks.
+  Frontier frontier(region.height, region.width);
+  Maze marked(region.height, region.width, 1);
+  Weights weights(rng);
+  const auto enqueue = [&](int i, int j) {
+    if (!marked.UnsafeAt(i, j)) {
+      marked.UnsafeSet(i, j, true);
+      frontier.Push(weights(), i, j);
+    }
+  };
+  const auto at = [&](int i, int j) { return maze.UnsafeAt(i, j); };
+  const auto deg = [&](int i, int j) {
+    return at(i - 1, j) + at(i, j - 1) + at(i, j + 1) + at(i + 1, j);
+  };
+  marked.Fill(false);
+  marked.FillBorder(true);
+  enqueue(region.height / 2, region.width / 2);
+  while (!frontier.empty()) {
+    const auto [li, lj] = frontier.Pop();
+    const int i = region.top + li;
+    const int j = region.left + lj;
+    if constexpr (Rules::kLimitDensity) {
+      if (density.UnsafeAt(i, j) > limitDensityThreshold) {
+        continue;
+      }
+    }
+    if constexpr (Rules::kNoLoops) {
+      if (const int d = deg(i, j); d > 1) {
+        if constexpr (Bridges::kEnabled) {
+          if (d == 2 && bridges.Accept(i, j)) {
+            maze.UnsafeSet(i, j, true);
+            if constexpr (Rules::kLimitDensity) {
+              density.Mark(i, j);
+            }
+          }
+        }
+        continue;
+      }
+    } else if constexpr (Rules::kNoSmallSquares) {
+      if ((at(i - 1, j) && at(i - 1, j - 1) && at(i, j - 1)) ||
+          (at(i, j - 1) && at(i + 1, j - 1) && at(i + 1, j)) ||
+          (at(i + 1, j) && at(i + 1, j + 1) && at(i, j + 1)) ||
+          (at(i, j + 1) && at(i - 1, j + 1) && at(i - 1, j))) {
+        continue;
+      }
+    }
+    maze.UnsafeSet(i, j, true);
+    if constexpr (Rules::kLimitDensity) {
+      density.Mark(i, j);
+    }
+    enqueue(li - 1, lj);
+    enqueue(li, lj - 1);
+    enqueue(li, lj + 1);
+    enqueue(li + 1, lj);
+  }
+}
+
+// Grows the maze within the region, starting from the centre of the region.
+// The cells outside the region are never changed, but they constrain
+// the growth through the rules.
+template <typename Rules, typename RngT, typename Bridges = NoBridges>
+void GrowRegion(Maze& maze,
+                algorithm::DiamondCounter<typename Rules::Count>& density,
+                size_t limitDensityThreshold, Region region, RngT& rng,
+                Bridges&& bridges = {}) {
+  if constexpr (Rules::kQueue == GenMazeQueue::kBucket) {
+    if (BucketFrontier<uint32_t>::Fits(region.height, region.width)) {
+      GrowRegionWith<Rules, BucketFrontier<uint32_t>>(
+          maze, density, limitDensityThreshold, region, rng, bridges);
+    } else {
+      GrowRegionWith<Rules, BucketFrontier<uint64_t>>(
+          maze, density, limitDensityThreshold, region, rng, bridges);
+    }
+  } else {
+    GrowRegionWith<Rules, HeapFrontier>(maze, density, limitDensityThreshold,
+                                        region, rng, bridges);
+  }
+}
+
+// Returns a density counter for the maze; the counter is empty if the density
+// is not limited.
+template <typename Rules>
+algorithm::DiamondCounter<typename Rules::Count> MakeDensityCounter(
+    int n, int m, const GenMazeOptions& options) {
+  if constexpr (Rules::kLimitDensity) {
+    return algorithm::DiamondCounter<typename Rules::Count>(
+        n, m, options.limitDensityR,
+        static_cast<typename Rules::Count>(DensityCap(
+            options.limitDensityR, options.limitDensityThreshold)));
+  } else {
+    return {};
+  }
+}
+
+template <typename Rules, typename RngT>
+Maze GenMaze(int n, int m, RngT& rng, const GenMazeOptions& options) {
+  // The maze has a border of walls, so the neighbour lookups need no bounds
+  // checks.
+  Maze result(n, m, 1);
+  result.Fill(false);
+  // The number of halls within the hamming diamond of every cell.
+  auto density = MakeDensityCounter<Rules>(n, m, options);
+  GrowRegion<Rules>(result, density, options.limitDensityThreshold,
+                    Region{0, 0, n, m}, rng);
+  if (options.pruneStubs) {
+    PruneStubs(result);
+  }
+  return result;
+}
+
+// The Kruskal engine. The halls are at (2 * r, 2 * c), and every edge of
+// the lattice is a wall cell between two of them. The edges are processed in
+// bands of lattice rows, each band shuffled separately, so only the disjoint
+// set forest takes memory proportional to the maze. A band also takes
+// the vertical edges entering it from the band above; otherwise all of them
+// would join singletons and open a whole row.
+template <typename RngT>
+Maze GenKruskalMaze(int n, int m, RngT& rng, const GenMazeOptions& options) {
+  constexpr size_t kBandEdges = size_t{1} << 16;
+  const int rows = (n + 1) / 2;
+  const int cols = (m + 1) / 2;
+  Maze result(n, m, 1);
+  result.Fill(false);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      result.UnsafeSet(2 * r, 2 * c, true);
+    }
+  }
+  algorithm::UnionFind<uint32_t> sets(static_cast<size_t>(rows) * cols);
+  Weights weights(rng);
+  // An edge is the lattice cell and the direction: 0 is right, 1 is down.
+  std::vector<uint64_t> band;
+  const int bandRows =
+      std::max<int>(1, kBandEdges / (2 * static_cast<size_t>(cols)));
+  for (int top = 0; top < rows; top += bandRows) {
+    const int bottom = std::min(rows, top + bandRows);
+    band.clear();
+    for (int r = std::max(top - 1, 0); r < bottom; ++r) {
+      for (int c = 0; c < cols; ++c) {
+        const uint64_t cell = static_cast<uint64_t>(r) * cols + c;
+        if (r >= top && c + 1 < cols) {
+          band.push_back(2 * cell);
+        }
+        if (r + 1 < bottom) {
+          band.push_back(2 * cell + 1);
+        }
+      }
+    }
+    for (size_t k = band.size(); k > 1; --k) {
+      const size_t l = static_cast<size_t>(
+          (static_cast<uint64_t>(static_cast<uint32_t>(weights())) * k) >> 32);
+      std::swap(band[k - 1], band[l]);
+    }
+    for (const uint64_t edge : band) {
+      const uint64_t cell = edge / 2;
+      const uint64_t other = (edge % 2 == 0 ? cell + 1 : cell + cols);
+      if (sets.Union(static_cast<uint32_t>(cell),
+                     static_cast<uint32_t>(other))) {
+        const int r = static_cast<int>(cell / cols);
+        const int c = static_cast<int>(cell % cols);
+        result.UnsafeSet(2 * r + edge % 2, 2 * c + 1 - edge % 2, true);
+      }
+    }
+  }
+  if (options.pruneStubs) {
+    PruneStubs(result);
+  }
+  return result;
+}
+
+}  // namespace internal
+
+template <GenMazeOptions kOptions, typename RngT>
+Maze GenMaze(int n, int m, RngT&& rng) {
+  if constexpr (kOptions.engine == GenMazeEngine::kKruskal) {
+    return internal::GenKruskalMaze(n, m, rng, kOptions);
+  } else {
+    return internal::GenMaze<internal::GrowthRulesOf<kOptions>>(n, m, rng,
+                                                                kOptions);
+  }
+}
+
 }  // namespace u7::maze
 
 #endif  // U7_MAZE_MAZE_H_
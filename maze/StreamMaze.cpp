@@ -0,0 +1,119 @@
+#include "maze/StreamMaze.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace u7::maze {
+
+StreamMazeResult GenStreamMaze(int64_t n, int m, Rng rng, const RowSink& sink) {
+  if (n < 1 || m < 1) {
+    throw std::runtime_error("the maze must have at least one cell");
+  }
+  // The halls of the lattice are at (2 * r, 2 * c); the cells between them
+  // are the passages.
+  const int64_t rows = (n + 1) / 2;
+  const int cols = (m + 1) / 2;
+  const auto random = [&](int k) {
+    return static_cast<int>(static_cast<unsigned>(rng()) % k);
+  };
+  std::vector<uint64_t> row((m + 63) / 64);
+  const auto setHall = [&](int j) { row[j / 64] |= uint64_t{1} << (j % 64); };
+  const auto emit = [&](int64_t i) {
+    sink(i, std::span<const uint64_t>(row));
+    std::fill(row.begin(), row.end(), 0);
+  };
+  // The set of every column of the current row. The set ids are in
+  // [0, cols), and `parent` is a disjoint set forest over them that is reset
+  // after every row.
+  std::vector<int> sets(cols);
+  std::vector<int> parent(cols);
+  std::iota(sets.begin(), sets.end(), 0);
+  std::iota(parent.begin(), parent.end(), 0);
+  const auto find = [&](int x) {
+    while (parent[x] != x) {
+      x = parent[x] = parent[parent[x]];
+    }
+    return x;
+  };
+  std::vector<uint8_t> down(cols);
+  std::vector<uint8_t> hasDown(cols);
+  std::vector<int> members(cols);
+  std::vector<int> chosen(cols);
+  for (int64_t r = 0; r < rows; ++r) {
+    const bool last = (r + 1 == rows);
+    // Join the neighbouring columns of different sets at random; the last
+    // row joins all of them.
+    for (int c = 0; c < cols; ++c) {
+      setHall(2 * c);
+    }
+    for (int c = 0; c + 1 < cols; ++c) {
+      const int a = find(sets[c]);
+      const int b = find(sets[c + 1]);
+      if (a != b && (last || random(2) == 0)) {
+        parent[a] = b;
+        setHall(2 * c + 1);
+      }
+    }
+    for (int c = 0; c < cols; ++c) {
+      sets[c] = find(sets[c]);
+    }
+    emit(2 * r);
+    if (last) {
+      break;
+    }
+    // Every set goes down through at least one column; if no column was
+    // picked at random, one of the set's columns is chosen uniformly.
+    for (int c = 0; c < cols; ++c) {
+      const int s = sets[c];
+      down[c] = (random(2) == 0);
+      hasDown[s] |= down[c];
+      if (random(++members[s]) == 0) {
+        chosen[s] = c;
+      }
+    }
+    for (int c = 0; c < cols; ++c) {
+      const int s = sets[c];
+      if (!hasDown[s]) {
+        down[chosen[s]] = hasDown[s] = 1;
+      }
+    }
+    for (int c = 0; c < cols; ++c) {
+      if (down[c]) {
+        setHall(2 * c);
+      }
+    }
+    emit(2 * r + 1);
+    // The columns that did not go down start new sets. There are enough
+    // unused ids, since every used id has a column that went down.
+    std::fill(hasDown.begin(), hasDown.end(), 0);
+    for (int c = 0; c < cols; ++c) {
+      if (down[c]) {
+        hasDown[sets[c]] = 1;
+      }
+    }
+    int freeId = 0;
+    for (int c = 0; c < cols; ++c) {
+      if (!down[c]) {
+        while (hasDown[freeId]) {
+          ++freeId;
+        }
+        sets[c] = freeId++;
+      }
+    }
+    std::iota(parent.begin(), parent.end(), 0);
+    std::fill(hasDown.begin(), hasDown.end(), 0);
+    std::fill(members.begin(), members.end(), 0);
+  }
+  if (n % 2 == 0) {
+    emit(n - 1);
+  }
+  return StreamMazeResult{
+      .entranceJ = 2 * random(cols),
+      .exitI = 2 * (rows - 1),
+      .exitJ = 2 * random(cols),
+  };
+}
+
+}  // namespace u7::maze
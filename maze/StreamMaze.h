@@ -0,0 +1,38 @@
+#ifndef U7_MAZE_STREAM_MAZE_H_
+#define U7_MAZE_STREAM_MAZE_H_
+
+#include "maze/Maze.h"
+
+#include <cstdint>
+#include <functional>
+#include <span>
+
+namespace u7::maze {
+
+// Receives the maze rows in order. The bit j % 64 of row[j / 64] is set iff
+// the cell (i, j) is a hall; the padding bits are zero. The row is only valid
+// during the call.
+using RowSink =
+    std::function<void(int64_t i, std::span<const uint64_t> row)>;
+
+struct StreamMazeResult {
+  // The entrance is in the first row.
+  int entranceJ;
+  // The exit is in the last row that has halls.
+  int64_t exitI;
+  int exitJ;
+};
+
+// Generates an n x m maze row by row with Eller's algorithm, passing every
+// row to the sink as soon as it is complete.
+//
+// Only O(m) state is kept regardless of n, so the maze may be far larger
+// than the memory. The halls are placed on the even rows and columns and
+// joined into a spanning tree, so the maze has neither loops nor small
+// squares and every two halls are connected; in particular, the entrance and
+// the exit. If n or m is even, the last row or column is a wall.
+StreamMazeResult GenStreamMaze(int64_t n, int m, Rng rng, const RowSink& sink);
+
+}  // namespace u7::maze
+
+#endif  // U7_MAZE_STREAM_MAZE_H_
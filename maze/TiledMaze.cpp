@@ -0,0 +1,305 @@
+#include "maze/TiledMaze.h"
+
+#include "algorithm/Hash.h"
+#include "algorithm/ParallelFor.h"
+#include "algorithm/Philox.h"
+#include "algorithm/UnionFind.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace u7::maze {
+namespace {
+
+using ::u7::algorithm::DeriveSeed;
+using ::u7::algorithm::DiamondCounter;
+using ::u7::algorithm::ParallelFor;
+using ::u7::algorithm::Philox4x32;
+using ::u7::algorithm::UnionFind;
+using ::u7::maze::internal::Region;
+
+Philox4x32 MakeRng(uint64_t seed, uint64_t stream) {
+  return Philox4x32(DeriveSeed(seed, stream));
+}
+
+class Tiling {
+ public:
+  Tiling(int n, int m, int tileSize)
+      : n_(n),
+        m_(m),
+        tileSize_(tileSize),
+        rows_(std::max(1, n / tileSize)),
+        cols_(std::max(1, m / tileSize)) {}
+
+  [[nodiscard]] int rows() const { return rows_; }
+
+  [[nodiscard]] int cols() const { return cols_; }
+
+  [[nodiscard]] int size() const { return rows_ * cols_; }
+
+  // The last row and column of tiles take the remainder, so every tile is at
+  // least tileSize wide (unless the maze is smaller).
+  [[nodiscard]] Region TileRegion(int ti, int tj) const {
+    const int top = ti * tileSize_;
+    const int left = tj * tileSize_;
+    return Region{top, left, (ti + 1 == rows_ ? n_ - top : tileSize_),
+                  (tj + 1 == cols_ ? m_ - left : tileSize_)};
+  }
+
+  [[nodiscard]] uint32_t TileOf(int i, int j) const {
+    return std::min(i / tileSize_, rows_ - 1) * cols_ +
+           std::min(j / tileSize_, cols_ - 1);
+  }
+
+ private:
+  int n_;
+  int m_;
+  int tileSize_;
+  int rows_;
+  int cols_;
+};
+
+// Lets a growing tile join its tree with the trees of the tiles grown in
+// the previous phases, at most once per tree. Since the tiles of the same phase
+// grow concurrently, the trees are identified by their roots at the beginning
+// of the phase, and the bridges that close a loop are removed afterwards.
+class TileBridges {
+ public:
+  struct Bridge {
+    int i;
+    int j;
+    uint32_t tile;
+  };
+
+  static constexpr bool kEnabled = true;
+
+  TileBridges(const Maze& maze, const Tiling& tiling, Region region,
+              const std::vector<uint32_t>& roots)
+      : maze_(maze), tiling_(tiling), region_(region), roots_(roots) {}
+
+  [[nodiscard]] const std::vector<Bridge>& bridges() const { return bridges_; }
+
+  // The cell has two hall neighbours; one of them is inside the region.
+  bool Accept(int i, int j) {
+    for (auto [ni, nj] : {std::pair{i - 1, j}, std::pair{i, j - 1},
+                          std::pair{i, j + 1}, std::pair{i + 1, j}}) {
+      if (maze_.UnsafeAt(ni, nj) && !Inside(ni, nj)) {
+        const uint32_t tile = tiling_.TileOf(ni, nj);
+        const uint32_t root = roots_[tile];
+        if (std::find(joined_.begin(), joined_.end(), root) != joined_.end()) {
+          return false;
+        }
+        joined_.push_back(root);
+        bridges_.push_back(Bridge{i, j, tile});
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  [[nodiscard]] bool Inside(int i, int j) const {
+    return (i >= region_.top && i < region_.top + region_.height &&
+            j >= region_.left && j < region_.left + region_.width);
+  }
+
+  const Maze& maze_;
+  const Tiling& tiling_;
+  Region region_;
+  const std::vector<uint32_t>& roots_;
+  std::vector<uint32_t> joined_;
+  std::vector<Bridge> bridges_;
+};
+
+// A border between two neighbouring tiles.
+struct Seam {
+  uint64_t priority;
+  int ti;
+  int tj;
+  bool vertical;  // Between (ti, tj) and (ti, tj + 1); otherwise (ti + 1, tj).
+};
+
+// Connects the tiles through single cells opened along the seams. Returns
+// false if some tiles remain disconnected.
+template <typename Rules>
+bool StitchTiles(Maze& maze, DiamondCounter<typename Rules::Count>& density,
+                 size_t limitDensityThreshold, const Tiling& tiling,
+                 uint64_t seed, UnionFind<uint32_t>& components) {
+  const int n = maze.n();
+  const int m = maze.m();
+  const auto at = [&](int i, int j) { return maze.UnsafeAt(i, j); };
+  if constexpr (!Rules::kNoLoops) {
+    // The tiles may already touch each other.
+    for (int tj = 1; tj < tiling.cols(); ++tj) {
+      const int j = tiling.TileRegion(0, tj).left;
+      for (int i = 0; i < n; ++i) {
+        if (at(i, j - 1) && at(i, j)) {
+          components.Union(tiling.TileOf(i, j - 1), tiling.TileOf(i, j));
+        }
+      }
+    }
+    for (int ti = 1; ti < tiling.rows(); ++ti) {
+      const int i = tiling.TileRegion(ti, 0).top;
+      for (int j = 0; j < m; ++j) {
+        if (at(i - 1, j) && at(i, j)) {
+          components.Union(tiling.TileOf(i - 1, j), tiling.TileOf(i, j));
+        }
+      }
+    }
+  }
+  std::vector<Seam> seams;
+  for (int ti = 0; ti < tiling.rows(); ++ti) {
+    for (int tj = 0; tj < tiling.cols(); ++tj) {
+      const uint64_t id = 2 * static_cast<uint64_t>(ti * tiling.cols() + tj);
+      if (tj + 1 < tiling.cols()) {
+        seams.push_back(Seam{DeriveSeed(seed, id), ti, tj, true});
+      }
+      if (ti + 1 < tiling.rows()) {
+        seams.push_back(Seam{DeriveSeed(seed, id + 1), ti, tj, false});
+      }
+    }
+  }
+  std::sort(seams.begin(), seams.end(), [](const Seam& lhs, const Seam& rhs) {
+    return lhs.priority < rhs.priority;
+  });
+  // Opens the wall cell if it joins the components `a` and `b` without
+  // breaking the rules.
+  const auto tryOpen = [&](int i, int j, uint32_t a, uint32_t b) {
+    if (at(i, j)) {
+      return false;
+    }
+    uint32_t neighbours[4];
+    int k = 0;
+    for (auto [ni, nj] : {std::pair{i - 1, j}, std::pair{i, j - 1},
+                          std::pair{i, j + 1}, std::pair{i + 1, j}}) {
+      if (at(ni, nj)) {
+        neighbours[k++] = components.Find(tiling.TileOf(ni, nj));
+      }
+    }
+    if (std::find(neighbours, neighbours + k, a) == neighbours + k ||
+        std::find(neighbours, neighbours + k, b) == neighbours + k) {
+      return false;
+    }
+    if constexpr (Rules::kNoLoops) {
+      if (k != 2) {
+        return false;
+      }
+    } else if constexpr (Rules::kNoSmallSquares) {
+      if ((at(i - 1, j) && at(i - 1, j - 1) && at(i, j - 1)) ||
+          (at(i, j - 1) && at(i + 1, j - 1) && at(i + 1, j)) ||
+          (at(i + 1, j) && at(i + 1, j + 1) && at(i, j + 1)) ||
+          (at(i, j + 1) && at(i - 1, j + 1) && at(i - 1, j))) {
+        return false;
+      }
+    }
+    if constexpr (Rules::kLimitDensity) {
+      if (density.UnsafeAt(i, j) > limitDensityThreshold) {
+        return false;
+      }
+    }
+    maze.UnsafeSet(i, j, true);
+    if constexpr (Rules::kLimitDensity) {
+      density.Mark(i, j);
+    }
+    for (int l = 1; l < k; ++l) {
+      components.Union(neighbours[0], neighbours[l]);
+    }
+    return true;
+  };
+  for (const auto& seam : seams) {
+    const uint32_t a = components.Find(tiling.TileOf(
+        tiling.TileRegion(seam.ti, seam.tj).top,
+        tiling.TileRegion(seam.ti, seam.tj).left));
+    const Region other = (seam.vertical
+                              ? tiling.TileRegion(seam.ti, seam.tj + 1)
+                              : tiling.TileRegion(seam.ti + 1, seam.tj));
+    const uint32_t b = components.Find(tiling.TileOf(other.top, other.left));
+    if (a == b) {
+      continue;
+    }
+    // Walk along the seam from a random position; try the cells on both
+    // sides of it.
+    const int length = (seam.vertical ? other.height : other.width);
+    const int offset = static_cast<int>(seam.priority % length);
+    for (int s = 0; s < length; ++s) {
+      const int x = (offset + s) % length;
+      const int i = (seam.vertical ? other.top + x : other.top);
+      const int j = (seam.vertical ? other.left : other.left + x);
+      const int pi = (seam.vertical ? i : i - 1);
+      const int pj = (seam.vertical ? j - 1 : j);
+      if (tryOpen(pi, pj, a, b) || tryOpen(i, j, a, b)) {
+        break;
+      }
+    }
+  }
+  return components.Components() == 1;
+}
+
+template <typename Rules>
+Maze GenTiledMaze(int n, int m, uint64_t seed, const GenMazeOptions& options,
+                  const GenTiledMazeOptions& tiledOptions) {
+  // The tiles of the same phase must be far enough from each other, so that
+  // their growth neither reads nor writes the same words of the maze, nor
+  // the same density counters.
+  const int tileSize =
+      std::max({tiledOptions.tileSize, 64, 2 * options.limitDensityR + 2});
+  const Tiling tiling(n, m, tileSize);
+  Maze result(n, m, 1);
+  result.Fill(false);
+  auto density = internal::MakeDensityCounter<Rules>(n, m, options);
+  UnionFind<uint32_t> components(tiling.size());
+  std::vector<uint32_t> roots(tiling.size());
+  for (int phase = 0; phase < 4; ++phase) {
+    for (int t = 0; t < tiling.size(); ++t) {
+      roots[t] = components.Find(t);
+    }
+    std::vector<uint32_t> tiles;
+    std::vector<TileBridges> bridges;
+    for (int ti = phase / 2; ti < tiling.rows(); ti += 2) {
+      for (int tj = phase % 2; tj < tiling.cols(); tj += 2) {
+        tiles.push_back(ti * tiling.cols() + tj);
+        bridges.emplace_back(result, tiling, tiling.TileRegion(ti, tj), roots);
+      }
+    }
+    ParallelFor(tiles.size(), tiledOptions.threads, [&](size_t k) {
+      auto rng = MakeRng(seed, tiles[k]);
+      internal::GrowRegion<Rules>(
+          result, density, options.limitDensityThreshold,
+          tiling.TileRegion(tiles[k] / tiling.cols(), tiles[k] % tiling.cols()),
+          rng, bridges[k]);
+    });
+    // The removed bridges stay in the density counters, which only makes
+    // the further growth a bit more conservative.
+    for (size_t k = 0; k < tiles.size(); ++k) {
+      for (const auto& bridge : bridges[k].bridges()) {
+        if (!components.Union(tiles[k], bridge.tile)) {
+          result.UnsafeSet(bridge.i, bridge.j, false);
+        }
+      }
+    }
+  }
+  if (!StitchTiles<Rules>(result, density, options.limitDensityThreshold,
+                          tiling, seed, components)) {
+    auto rng = MakeRng(seed, tiling.size());
+    return internal::GenMaze<Rules>(n, m, rng, options);
+  }
+  if (options.pruneStubs) {
+    internal::PruneStubs(result);
+  }
+  return result;
+}
+
+}  // namespace
+
+Maze GenTiledMaze(int n, int m, uint64_t seed, GenMazeOptions options,
+                  GenTiledMazeOptions tiledOptions) {
+  if (options.engine == GenMazeEngine::kKruskal) {
+    auto rng = MakeRng(seed, 0);
+    return internal::GenKruskalMaze(n, m, rng, options);
+  }
+  return internal::DispatchGrowthRules(options, [&]<typename Rules>() {
+    return GenTiledMaze<Rules>(n, m, seed, options, tiledOptions);
+  });
+}
+
+}  // namespace u7::maze
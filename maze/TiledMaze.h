@@ -0,0 +1,37 @@
+#ifndef U7_MAZE_TILED_MAZE_H_
+#define U7_MAZE_TILED_MAZE_H_
+
+#include "maze/Maze.h"
+
+#include <cstdint>
+
+namespace u7::maze {
+
+struct GenTiledMazeOptions {
+  // The side of a tile; it is increased to at least 64 and to more than twice
+  // the density radius.
+  int tileSize = 1024;
+
+  // The number of threads; non-positive means one thread per core.
+  int threads = 0;
+};
+
+// Generates a maze by growing square tiles on multiple threads and stitching
+// them together.
+//
+// Every tile grows from its centre with its own random generator derived from
+// the seed. The tiles are grown in four phases, so that the tiles of the same
+// phase never touch each other, while the tiles of the previous phases
+// constrain the growth through the rules; the rules hold across the tile
+// borders. Then the tiles are connected through single cells opened along
+// the borders, in a random spanning tree order. In the rare case when
+// the tiles cannot be connected this way, the maze is generated sequentially.
+//
+// The result depends only on the seed and the options, not on the number of
+// threads. The Kruskal engine is near-linear already, so it is not tiled.
+Maze GenTiledMaze(int n, int m, uint64_t seed, GenMazeOptions options = {},
+                  GenTiledMazeOptions tiledOptions = {});
+
+}  // namespace u7::maze
+
+#endif  // U7_MAZE_TILED_MAZE_H_
@@ -0,0 +1,112 @@
+// Replays a log recorded with `mazegl --record <path>` through Game as fast
+// as possible. For every round, prints the hash of the final states of the
+// players, which is the same on every run, and the simulation speed.
+//
+// Usage: maze_replay <replay> [repeats]
+//
+#include "algorithm/Hash.h"
+#include "game/ChunkedMap.h"
+#include "game/Game.h"
+#include "game/GameMap.h"
+#include "game/Replay.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <memory>
+
+using ::u7::algorithm::Mix64;
+using ::u7::game::ChunkedMap;
+using ::u7::game::Game;
+using ::u7::game::GenReplayMap;
+using ::u7::game::ReadReplay;
+using ::u7::game::Replay;
+using ::u7::game::ReplayRound;
+
+Game MakeGame(const ReplayRound& round) {
+  const auto& map = round.GetMap();
+  if (map.IsEndless()) {
+    return Game(std::make_shared<ChunkedMap>(map.seed, map.options),
+                round.GetPlayers());
+  }
+  const std::shared_ptr<const u7::game::GameMap> gameMap =
+      GenReplayMap(map, {.runs = true});
+  return Game(gameMap, round.GetPlayers());
+}
+
+uint64_t HashStates(const Game& game) {
+  uint64_t result = 0;
+  for (int i = 0; i < game.GetPlayers(); ++i) {
+    const auto state = game.GetPlayerState(i);
+    result = Mix64(result ^ std::bit_cast<uint64_t>(state.location.x));
+    result = Mix64(result ^ std::bit_cast<uint64_t>(state.location.y));
+    result = Mix64(result ^ std::bit_cast<uint64_t>(state.speed));
+    result = Mix64(result ^ static_cast<uint64_t>(state.touchedExit));
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2 && argc != 3) {
+    std::fprintf(stderr, "Usage: %s <replay> [repeats]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int repeats = (argc > 2 ? std::max(std::atoi(argv[2]), 1) : 1);
+  std::ifstream input(argv[1], std::ios::binary);
+  if (!input) {
+    std::fprintf(stderr, "Unable to open %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  Replay replay;
+  try {
+    replay = ReadReplay(input);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "Unable to read %s: %s\n", argv[1], e.what());
+    return EXIT_FAILURE;
+  }
+  std::printf("%5s %11s %7s %10s %8s %16s %14s\n", "round", "map", "players",
+              "ticks", "runs", "hash", "steps/s");
+  double totalSteps = 0.0;
+  double totalSeconds = 0.0;
+  for (size_t r = 0; r < replay.rounds.size(); ++r) {
+    const auto& round = replay.rounds[r];
+    uint64_t hash = 0;
+    double seconds = 0.0;
+    for (int i = 0; i < repeats; ++i) {
+      auto game = MakeGame(round);
+      const auto start = std::chrono::steady_clock::now();
+      round.ForEachRun([&](uint64_t ticks, auto actions) {
+        for (uint64_t t = 0; t < ticks; ++t) {
+          game.ApplyPlayerActions(actions, replay.tickSeconds);
+        }
+      });
+      seconds += std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+      hash = HashStates(game);
+    }
+    const double steps = static_cast<double>(round.GetTicks()) *
+                         round.GetPlayers() * repeats;
+    totalSteps += steps;
+    totalSeconds += seconds;
+    char map[32];
+    if (round.GetMap().IsEndless()) {
+      std::snprintf(map, sizeof(map), "endless");
+    } else {
+      std::snprintf(map, sizeof(map), "%dx%d", round.GetMap().width,
+                    round.GetMap().height);
+    }
+    std::printf("%5zu %11s %7d %10llu %8zu %016llx %14.0f\n", r, map,
+                round.GetPlayers(),
+                static_cast<unsigned long long>(round.GetTicks()),
+                round.GetRuns(), static_cast<unsigned long long>(hash),
+                steps / seconds);
+  }
+  std::printf("total: %.0f steps in %.3f s, %.0f steps/s\n", totalSteps,
+              totalSeconds, totalSteps / totalSeconds);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+// Streams a maze of any height into a PBM image, keeping only a few rows in
+// memory.
+//
+// Usage: maze_stream <height> <width> <seed> <output.pbm>
+//
+#include "maze/StreamMaze.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <vector>
+
+using ::u7::maze::GenStreamMaze;
+
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    std::fprintf(stderr, "Usage: %s <height> <width> <seed> <output.pbm>\n",
+                 argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int64_t n = std::strtoll(argv[1], nullptr, 10);
+  const int m = std::atoi(argv[2]);
+  std::mt19937 rng(std::strtoul(argv[3], nullptr, 10));
+  std::ofstream output(argv[4], std::ios::binary);
+  if (!output) {
+    std::fprintf(stderr, "Unable to open %s\n", argv[4]);
+    return EXIT_FAILURE;
+  }
+  output << "P4\n" << m << ' ' << n << '\n';
+  // PBM packs the pixels most significant bit first; the walls are black.
+  std::vector<char> bytes((m + 7) / 8);
+  const auto start = std::chrono::steady_clock::now();
+  const auto result =
+      GenStreamMaze(n, m, std::ref(rng), [&](int64_t /*i*/, auto row) {
+        for (int k = 0; k < static_cast<int>(bytes.size()); ++k) {
+          const auto halls = static_cast<uint8_t>(row[k / 8] >> (k % 8 * 8));
+          uint8_t byte = 0;
+          for (int b = 0; b < 8; ++b) {
+            byte |= ((halls >> b) & 1) << (7 - b);
+          }
+          bytes[k] = static_cast<char>(~byte);
+        }
+        if (m % 8 != 0) {
+          bytes.back() &= static_cast<char>(0xff00 >> (m % 8));
+        }
+        output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+      });
+  output.close();
+  if (!output) {
+    std::fprintf(stderr, "Unable to write %s\n", argv[4]);
+    return EXIT_FAILURE;
+  }
+  const std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - start;
+  std::fprintf(stderr, "entrance: (0, %d), exit: (%lld, %d)\n",
+               result.entranceJ, static_cast<long long>(result.exitI),
+               result.exitJ);
+  std::fprintf(stderr, "%.3f s, %.2f Mcells/s\n", seconds.count(),
+               static_cast<double>(n) * m / seconds.count() / 1e6);
+  return EXIT_SUCCESS;
+}